@@ -0,0 +1,77 @@
+#include <benchmark/benchmark.h>
+
+#include <scheme/profiler.h>
+#include <scheme/scheme.h>
+
+// Each benchmark defines its procedures once and then times a single call.
+static void RunDefined(benchmark::State& state, std::initializer_list<std::string> definitions,
+                       const std::string& expression, const std::string& expected) {
+    Interpreter interpreter;
+    for (auto& definition : definitions) {
+        interpreter.Run(definition);
+    }
+    for (auto _ : state) {
+        auto result = interpreter.Run(expression);
+        if (result != expected) {
+            state.SkipWithError(("unexpected result " + result).c_str());
+            break;
+        }
+    }
+}
+
+static void BM_Fib(benchmark::State& state) {
+    RunDefined(state, {"(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))"},
+               "(fib 20)", "6765");
+}
+BENCHMARK(BM_Fib)->Unit(benchmark::kMillisecond);
+
+// The same call while the profiler samples it, to compare against BM_Fib.
+static void BM_FibProfiled(benchmark::State& state) {
+    Profiler::Instance().Start();
+    BM_Fib(state);
+    Profiler::Instance().Stop();
+}
+BENCHMARK(BM_FibProfiled)->Unit(benchmark::kMillisecond);
+
+static void BM_Tak(benchmark::State& state) {
+    RunDefined(state,
+               {"(define (tak x y z) (if (not (< y x)) z"
+                "  (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y))))"},
+               "(tak 18 12 6)", "7");
+}
+BENCHMARK(BM_Tak)->Unit(benchmark::kMillisecond);
+
+static void BM_Ackermann(benchmark::State& state) {
+    RunDefined(state,
+               {"(define (ack m n) (if (= m 0) (+ n 1)"
+                "  (if (= n 0) (ack (- m 1) 1) (ack (- m 1) (ack m (- n 1))))))"},
+               "(ack 3 6)", "509");
+}
+BENCHMARK(BM_Ackermann)->Unit(benchmark::kMillisecond);
+
+static void BM_BuildList(benchmark::State& state) {
+    RunDefined(state,
+               {"(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))",
+                "(define (length l n) (if (null? l) n (length (cdr l) (+ n 1))))"},
+               "(length (build 1000000 '()) 0)", "1000000");
+}
+BENCHMARK(BM_BuildList)->Unit(benchmark::kMillisecond);
+
+static void BM_FoldList(benchmark::State& state) {
+    RunDefined(state,
+               {"(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))",
+                "(define (fold f acc l) (if (null? l) acc (fold f (f acc (car l)) (cdr l))))",
+                "(define xs (build 1000000 '()))"},
+               "(fold + 0 xs)", "500000500000");
+}
+BENCHMARK(BM_FoldList)->Unit(benchmark::kMillisecond);
+
+static void BM_Closures(benchmark::State& state) {
+    RunDefined(state,
+               {"(define (make-adder n) (lambda (x) (+ x n)))",
+                "(define (compose f g) (lambda (x) (f (g x))))",
+                "(define (loop i acc)"
+                "  (if (= i 0) acc (loop (- i 1) ((compose (make-adder 1) (make-adder i)) acc))))"},
+               "(loop 100000 0)", "5000150000");
+}
+BENCHMARK(BM_Closures)->Unit(benchmark::kMillisecond);
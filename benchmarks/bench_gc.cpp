@@ -0,0 +1,46 @@
+#include <benchmark/benchmark.h>
+
+#include <scheme/heap.h>
+#include <scheme/scheme.h>
+
+// Defines (build n acc), which conses the numbers from 1 to n onto acc, and a
+// list `live` of `size` cells with it.
+static void DefineLiveList(Interpreter& interpreter, int64_t size) {
+    interpreter.Run("(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))");
+    interpreter.Run("(define live (build " + std::to_string(size) + " '()))");
+}
+
+// Collects while a large list is live. Reported are the average pause and,
+// from the pause histogram of Heap::Stats, a bound on the longest one.
+static void BM_CollectLargeLiveHeap(benchmark::State& state) {
+    Interpreter interpreter;
+    DefineLiveList(interpreter, state.range(0));
+    auto& heap = Heap::Instance();
+    auto before = heap.Stats();
+    // The list is dropped rather than printed, which would dominate the time.
+    for (auto _ : state) {
+        interpreter.Run("(begin (build 10000 '()) 0)");
+    }
+    auto after = heap.Stats();
+    size_t longest = 0;
+    for (size_t i = 0; i < HeapStats::kPauseBuckets; ++i) {
+        if (after.pauses[i] > before.pauses[i]) {
+            longest = i;
+        }
+    }
+    state.counters["major_collections"] =
+        static_cast<double>(after.major_collections - before.major_collections);
+    state.counters["longest_pause_below_us"] = static_cast<double>(size_t{1} << longest);
+}
+BENCHMARK(BM_CollectLargeLiveHeap)->Arg(100'000)->Arg(1'000'000)->Unit(benchmark::kMicrosecond);
+
+// Copies a large live heap, which is what a compacting major collection costs.
+static void BM_CompactLargeLiveHeap(benchmark::State& state) {
+    Interpreter interpreter;
+    DefineLiveList(interpreter, state.range(0));
+    for (auto _ : state) {
+        Heap::Instance().Compact();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CompactLargeLiveHeap)->Arg(1'000'000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,64 @@
+#include <benchmark/benchmark.h>
+
+#include <scheme/heap.h>
+#include <scheme/parser.h>
+#include <scheme/tokenizer.h>
+
+#include <sstream>
+
+// About a megabyte of definitions like the ones generated scripts are made of.
+static const std::string& GeneratedSource() {
+    static const std::string source = [] {
+        std::string source = "(";
+        for (int i = 0; source.size() < (1 << 20); ++i) {
+            auto n = std::to_string(i);
+            source += "(define (procedure-" + n + " x y) (if (< x " + n + ") '(a b . c) (+ x y " +
+                      n + ")))\n";
+        }
+        return source + ")";
+    }();
+    return source;
+}
+
+template <class... Input>
+static size_t CountTokens(Input... input) {
+    Tokenizer tokenizer(input...);
+    size_t tokens = 0;
+    while (not tokenizer.IsEnd()) {
+        benchmark::DoNotOptimize(tokenizer.GetToken());
+        tokenizer.Next();
+        ++tokens;
+    }
+    return tokens;
+}
+
+static void BM_Tokenizer(benchmark::State& state) {
+    auto& source = GeneratedSource();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(CountTokens(std::string_view(source)));
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_Tokenizer)->Unit(benchmark::kMillisecond);
+
+static void BM_TokenizerStream(benchmark::State& state) {
+    auto& source = GeneratedSource();
+    for (auto _ : state) {
+        std::stringstream in{source};
+        benchmark::DoNotOptimize(CountTokens(&in));
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_TokenizerStream)->Unit(benchmark::kMillisecond);
+
+static void BM_Read(benchmark::State& state) {
+    auto& source = GeneratedSource();
+    for (auto _ : state) {
+        Tokenizer tokenizer{std::string_view(source)};
+        benchmark::DoNotOptimize(Read(&tokenizer));
+        // Nothing is rooted, so this frees what was read.
+        Heap::Instance().Collect();
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_Read)->Unit(benchmark::kMillisecond);
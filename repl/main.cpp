@@ -1,17 +1,99 @@
+#include <fstream>
 #include <iostream>
+#include <string_view>
+#include "scheme/profiler.h"
 #include "scheme/scheme.h"
 
-int main() {
+// With --profile <file> the session is profiled: folded stacks are written to
+// the file and a summary per procedure to stderr. With --script <file> the
+// file is evaluated instead of stdin, and the exit status tells whether it
+// ran without errors. With --image <file> the session starts from the
+// definitions saved in an image, and with --save-image <file> it saves its own
+// at the end.
+int main(int argc, char** argv) {
+    const char* profile = nullptr;
+    const char* script = nullptr;
+    const char* image = nullptr;
+    const char* save_image = nullptr;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view flag = argv[i];
+        if (flag == "--profile") {
+            profile = argv[i + 1];
+        } else if (flag == "--script") {
+            script = argv[i + 1];
+        } else if (flag == "--image") {
+            image = argv[i + 1];
+        } else if (flag == "--save-image") {
+            save_image = argv[i + 1];
+        } else {
+            std::cerr << "Unknown flag " << flag << std::endl;
+            return 2;
+        }
+    }
+    if (argc % 2 == 0) {
+        std::cerr << "Usage: " << argv[0] << " [--profile <file>] [--script <file>]"
+                  << " [--image <file>] [--save-image <file>]" << std::endl;
+        return 2;
+    }
+    if (profile) {
+        Profiler::Instance().Start();
+    }
+    int status = 0;
     std::string line;
     Interpreter interpreter;
-    while (getline(std::cin, line)) {
+    if (image) {
+        try {
+            interpreter.LoadImage(image);
+        } catch (std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    if (script) {
         try {
-            std::cout << interpreter.Run(line) << std::endl;
-        } catch (RuntimeError& e) {
+            interpreter.RunFile(script);
+        } catch (std::runtime_error& e) {
             std::cerr << e.what() << std::endl;
-        } catch (NameError& e) {
+            status = 1;
+        }
+    }
+    // Forms may span lines, and a line may hold several of them.
+    while (not script && getline(std::cin, line)) {
+        interpreter.Feed(line + '\n');
+        while (true) {
+            try {
+                auto result = interpreter.RunNext();
+                if (not result) {
+                    break;
+                }
+                std::cout << *result << std::endl;
+            } catch (std::runtime_error& e) {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+    }
+    if (not script && interpreter.HasPartialInput()) {
+        std::cerr << "Incomplete form at the end of the input" << std::endl;
+        status = 1;
+    }
+    if (save_image) {
+        try {
+            interpreter.SaveImage(save_image);
+        } catch (std::runtime_error& e) {
             std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+    }
+    if (profile) {
+        auto& profiler = Profiler::Instance();
+        profiler.Stop();
+        std::ofstream out(profile);
+        profiler.WriteFolded(out);
+        std::cerr << "calls\tinclusive ms\texclusive ms\tprocedure\n";
+        for (auto& procedure : profiler.GetProcedures()) {
+            std::cerr << procedure.calls << '\t' << procedure.inclusive.count() / 1e6 << '\t'
+                      << procedure.exclusive.count() / 1e6 << '\t' << procedure.name << '\n';
         }
     }
-    return 0;
+    return status;
 }
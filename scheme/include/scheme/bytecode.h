@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "object.h"
+
+enum class OpCode : uint8_t {
+    CONSTANT,            // push constants[arg]
+    LOAD_LOCAL,          // push slot arg of the frame depth levels up
+    LOAD_GLOBAL,         // push the global value of the symbol constants[arg]
+    DEFINE_LOCAL,        // store the popped value into slot arg of the current frame, push ()
+    DEFINE_GLOBAL,       // bind the symbol constants[arg] to the popped value, push ()
+    SET_LOCAL,           // store the popped value into slot arg depth levels up, push ()
+    SET_GLOBAL,          // set! the symbol constants[arg] to the popped value, push ()
+    POP,                 // drop the top of the stack
+    JUMP,                // continue at arg
+    JUMP_IF_FALSE,       // pop, continue at arg if the value was #f
+    JUMP_IF_FALSE_KEEP,  // continue at arg keeping the top if it is #f, pop it otherwise
+    JUMP_IF_TRUE_KEEP,   // continue at arg keeping the top if it is not #f, pop it otherwise
+    MAKE_LAMBDA,         // push a closure over the current frame for the Code constants[arg]
+    CALL,                // call the procedure below arg arguments
+    TAIL_CALL,           // same as CALL, replacing the current frame with the callee's
+    RETURN,              // leave the current frame with the top of the stack
+};
+
+struct Instruction {
+    OpCode op;
+    uint16_t depth = 0;
+    uint32_t arg = 0;
+};
+
+// Where a global reference found its value the last time it ran.
+struct GlobalCache {
+    const Environment* scope = nullptr;
+    uint64_t version = 0;
+    const Value* slot = nullptr;
+};
+
+// A compiled procedure body or top-level expression.
+// The first arity slots of a procedure frame hold its arguments, the rest its
+// internal definitions.
+class Code : public Object {
+    std::vector<Instruction> instructions_;
+    std::vector<Value> constants_;
+    // One for each constant, used by the global references to it. Code in
+    // the arena is shared by interpreters, so each cache also records the
+    // scope it is valid for. The caches are not references the collector
+    // must know about: they are only followed while they match.
+    std::vector<GlobalCache> caches_;
+    size_t arity_;
+    size_t frame_size_;
+    // The name the procedure was defined with, or `lambda`.
+    Symbol* name_ = nullptr;
+
+public:
+    static constexpr ObjectType kType = ObjectType::CODE;
+
+    Code(size_t arity = 0, size_t frame_size = 0);
+
+    size_t GetArity() const { return arity_; }
+    size_t GetFrameSize() const { return frame_size_; }
+    Symbol* GetName() const { return name_; }
+    void SetName(Symbol* name) { name_ = name; }
+    const Instruction& At(size_t pc) const { return instructions_[pc]; }
+    Value GetConstant(size_t i) const { return constants_[i]; }
+    size_t ConstantCount() const { return constants_.size(); }
+    GlobalCache& GetCache(size_t i) { return caches_[i]; }
+
+    size_t Emit(OpCode op, uint32_t arg = 0, uint16_t depth = 0);
+    void Patch(size_t at, uint32_t target);
+    size_t Size() const;
+    uint32_t AddConstant(Value);
+
+protected:
+    void Trace(Tracer& tracer) override;
+    std::string ToString() const override;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "bytecode.h"
+#include "object.h"
+
+// Holds the procedure bodies of loaded files and the constants they use for
+// the lifetime of the process, outside the collected heap. Objects are
+// bump-allocated in chunks and marked permanent, so the collector never walks
+// them however often the procedures they implement run.
+//
+// Everything is hash-consed: numbers with the same value and lists with the
+// same elements are stored once and shared by all the code that quotes them.
+// That makes them immutable, and it keeps them from referencing the heap.
+// Procedure bodies are shared the same way, so loading a file again adds
+// nothing to the arena.
+class CodeArena {
+    static constexpr size_t kChunkSize = 64 * 1024;
+    static constexpr size_t kGranularity = alignof(std::max_align_t);
+
+    struct PairHash {
+        size_t operator()(const std::pair<uintptr_t, uintptr_t>& pair) const {
+            return std::hash<uintptr_t>()(pair.first * 0x9e3779b97f4a7c15 ^ pair.second);
+        }
+    };
+
+    std::vector<std::unique_ptr<std::byte[]>> chunks_;
+    std::byte* top_ = nullptr;
+    std::byte* limit_ = nullptr;
+    size_t size_ = 0;
+    // Objects that own memory outside the arena, destroyed with it.
+    std::vector<Object*> finalizable_;
+    std::unordered_map<int64_t, Number*> numbers_;
+    // Cells by the bits of their first and second values.
+    std::unordered_map<std::pair<uintptr_t, uintptr_t>, Cell*, PairHash> cells_;
+    // Codes by their contents, see InternCode.
+    std::unordered_map<std::string, Code*> codes_;
+
+    CodeArena() = default;
+    ~CodeArena();
+    CodeArena(const CodeArena&) = delete;
+
+    void* Allocate(size_t size);
+    Value InternCell(Value first, Value second);
+    Code* InternCode(Code* code);
+
+public:
+    static CodeArena& Instance() {
+        static CodeArena arena;
+        return arena;
+    }
+
+    template <std::derived_from<Object> T, class... Args>
+    T* Make(Args... args) requires std::constructible_from<T, Args...> {
+        static_assert(alignof(T) <= kGranularity);
+        T* object = new (Allocate(sizeof(T))) T(args...);
+        object->is_permanent_ = true;
+        // Numbers and cells own nothing, unlike the vectors of a Code.
+        if constexpr (std::is_same_v<T, Code>) {
+            finalizable_.push_back(object);
+        }
+        return object;
+    }
+
+    // Returns the arena copy of a datum or a finished code, shared with every
+    // equal one.
+    Value Intern(Value datum);
+
+    // Bytes taken by the objects in the arena.
+    size_t Size() const { return size_; }
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "bytecode.h"
+
+class CodeArena;
+
+// Translates a parsed expression into bytecode for the VM.
+// Special forms are recognised by name; everything else is an application.
+// The returned code is always allocated in the heap. Given an `arena`, the
+// procedure bodies and constants it refers to are interned there.
+Code* Compile(Value ast, CodeArena* arena = nullptr);
@@ -4,21 +4,261 @@
 
 #pragma once
 
+#include <array>
+#include <chrono>
 #include <set>
 #include <string>
 #include <string_view>
 #include <iostream>
+#include <cstddef>
+#include <new>
 #include "object.h"
 
+// Memory the collector has freed is poisoned in sanitizer builds, so that a
+// missing root or barrier shows up as a use-after-free.
+#if __has_include(<sanitizer/asan_interface.h>)
+#include <sanitizer/asan_interface.h>
+#else
+#define ASAN_POISON_MEMORY_REGION(addr, size) ((void)(addr), (void)(size))
+#define ASAN_UNPOISON_MEMORY_REGION(addr, size) ((void)(addr), (void)(size))
+#endif
+
+// A generational heap. New objects are bump-allocated in the nursery. A minor
+// collection copies the young objects that are still reachable into the old
+// generation and then empties the nursery, so it costs time proportional to the
+// surviving young data. Old objects that are given a reference to a young one
+// are recorded in the remembered set by the write barrier and serve as roots
+// for the minor collection. The old generation is marked from the registered
+// roots and swept lazily in a major collection once it has doubled in size. Old
+// objects live in slab pools segregated by size class. In compacting mode a
+// major collection instead copies the live old objects into fresh pages in
+// breadth-first order, so that list cells end up next to each other.
+//
+// Major marking is tri-color: white objects are unmarked, grey ones are marked
+// and waiting in the worklist, black ones are marked and traced. Incremental
+// marking traces a bounded number of grey objects per collection, so a major
+// cycle is spread over several runs. While it is in progress the write barrier
+// shades every old object stored into another, which keeps black objects from
+// ever pointing at white ones, and promoted objects start out grey. Large
+// slices are traced by a pool of threads that steal grey objects from each
+// other; the mutator is stopped meanwhile, so the barrier stays single-threaded.
+//
+// Each major collection marks with a new epoch, so objects marked by the one
+// before count as white without their marks being cleared. Once marking is
+// done every page is due for sweeping, and the pool sweeps it the next time it
+// needs a free slot. Objects allocated meanwhile go to swept pages only.
+//
+// Allocation never collects by itself. Once the first nursery chunk is full a
+// collection is requested, and the evaluator runs it at its next safe point,
+// where every live reference is either in the old generation or in a
+// registered RootSet such as the VM stack. Code between safe points may thus
+// hold raw object pointers in C++ locals.
+
+// What the heap has allocated and collected so far, as returned by Heap::Stats.
+struct HeapStats {
+    static constexpr size_t kPauseBuckets = 20;
+
+    struct Usage {
+        size_t objects = 0;
+        size_t bytes = 0;
+    };
+
+    // Objects not freed yet, indexed by ObjectType. Garbage counts until it is
+    // collected, and memory that objects own outside the heap is left out.
+    std::array<Usage, kObjectTypes> usage{};
+    size_t allocated_bytes = 0;
+    // Memory mapped for the old generation: the pages of the size classes,
+    // plus one mapping for each object too large for them.
+    size_t pages = 0;
+    size_t page_bytes = 0;
+    // Bytes allocated per second since the heap was created.
+    double allocation_rate = 0;
+    size_t minor_collections = 0;
+    size_t major_collections = 0;
+    std::chrono::nanoseconds mark_time{0};
+    std::chrono::nanoseconds sweep_time{0};
+    // Collect calls by duration: bucket i counts those shorter than 2^i
+    // microseconds but not shorter than 2^(i-1), the last one the longer rest.
+    std::array<size_t, kPauseBuckets> pauses{};
+};
+
+// Memory outside the heap that holds references, like the VM value stack.
+class RootSet {
+public:
+    virtual void TraceRoots(Tracer& tracer) = 0;
+
+protected:
+    ~RootSet() = default;
+};
+
 class Heap {
-    std::vector<std::unique_ptr<Object>> objects_;
+    // A list of fixed-size chunks filled by bumping a pointer. All but the
+    // first chunk are released when the nursery is emptied.
+    class Nursery {
+        static constexpr size_t kChunkSize = 256 * 1024;
+
+        std::vector<std::unique_ptr<std::byte[]>> chunks_;
+        std::byte* top_ = nullptr;
+        std::byte* limit_ = nullptr;
+
+        void AddChunk();
+
+    public:
+        Nursery();
+
+        // Returns room for `size` bytes without claiming it yet.
+        void* Peek(size_t size) {
+            if (static_cast<size_t>(limit_ - top_) < size) {
+                AddChunk();
+            }
+            ASAN_UNPOISON_MEMORY_REGION(top_, size);
+            return top_;
+        }
+        void Bump(size_t size) { top_ += size; }
+        bool IsOverflowing() const { return chunks_.size() > 1; }
+        void Reset();
+    };
+
+    // Fixed-size slots carved out of pages mapped from the OS. Freed slots are
+    // reused through per-page free lists, and pages that a sweep leaves empty
+    // are unmapped.
+    class Pool {
+        struct Page;
+
+        size_t slot_size_ = 0;
+        HeapStats* stats_ = nullptr;
+        // The first unswept_ pages still have to be swept.
+        std::vector<Page*> pages_;
+        size_t unswept_ = 0;
+        uint8_t epoch_ = 0;
+        // Swept pages with free slots, linked through Page::next_available.
+        Page* available_ = nullptr;
+
+        void AddPage();
+        void SweepPage();
+
+    public:
+        Pool() = default;
+        Pool(const Pool&) = delete;
+        ~Pool();
+
+        // Objects the pool frees are subtracted from `stats`.
+        void Init(size_t slot_size, HeapStats* stats) {
+            slot_size_ = slot_size;
+            stats_ = stats;
+        }
+        void Swap(Pool& other) noexcept;
+        void* Allocate();
+        // Makes every page due for sweeping: objects not marked with `epoch`
+        // are destroyed when their page is swept.
+        void StartSweep(uint8_t epoch);
+        void FinishSweep();
+    };
+
+    class Evacuator;
+    class Marker;
+    class Copier;
+    class MarkWorkers;
+
+    static constexpr size_t kGranularity = alignof(std::max_align_t);
+    static constexpr size_t kSizeClasses = 16;
+    static constexpr size_t kBufferCapacity = 1024;
+    static constexpr size_t kMinMajorThreshold = 1024;
+
+    // Young objects that own memory outside the nursery and must be destroyed
+    // when it is emptied. The others are simply overwritten.
+    template <class T>
+    static constexpr bool kNeedsFinalization =
+        not(std::is_same_v<T, Number> || std::is_same_v<T, Cell> || std::is_same_v<T, Lambda>);
+
+    // Young objects are only counted in young_, the others in stats_.
+    HeapStats stats_;
+    std::array<HeapStats::Usage, kObjectTypes> young_{};
+    std::chrono::steady_clock::time_point created_ = std::chrono::steady_clock::now();
+
+    Nursery nursery_;
+    std::vector<Object*> finalizable_;
+    std::vector<Object*> remembered_;
+    std::vector<Object*> promoted_;
+    std::array<Pool, kSizeClasses> pools_;
+    // Old objects too large for any size class, each in a mapping of its own.
+    // They are all swept as soon as marking ends.
+    struct LargeObject {
+        void* memory;
+        size_t size;
+    };
+    std::vector<LargeObject> large_;
+    // Old objects allocated since the last major collection plus those it marked.
+    size_t old_count_ = 0;
+    // Objects that live as long as the process and are never swept. They must
+    // not reference collectable objects, since nothing marks through them.
+    std::vector<std::unique_ptr<Object>> permanent_;
+    std::vector<RootSet*> root_sets_;
+    std::vector<Object*> grey_;
+    uint8_t epoch_ = 1;
+    size_t marked_ = 0;
+    bool marking_ = false;
+    bool compacting_ = false;
+    size_t mark_slice_ = kDefaultMarkSlice;
+    size_t mark_threads_ = 1;
+    // Started by the first slice large enough to share between threads.
+    std::unique_ptr<MarkWorkers> mark_workers_;
+    size_t next_major_ = kMinMajorThreshold;
 
 private:
-    Heap() = default;
+    Heap();
+    ~Heap();
     Heap(const Heap&) = delete;
     Heap(Heap&&) = delete;
 
+    static constexpr size_t SlotSize(size_t size) {
+        return (size + kGranularity - 1) / kGranularity * kGranularity;
+    }
+    template <class T>
+    void* AllocateOld() {
+        ++old_count_;
+        auto& usage = stats_.usage[static_cast<size_t>(T::kType)];
+        ++usage.objects;
+        usage.bytes += SlotSize(sizeof(T));
+        if constexpr (sizeof(T) > kSizeClasses * kGranularity) {
+            return AllocateLarge(SlotSize(sizeof(T)));
+        } else {
+            return pools_[(sizeof(T) - 1) / kGranularity].Allocate();
+        }
+    }
+    void* AllocateLarge(size_t size);
+    void FreeLarge(const LargeObject& large);
+    void SweepLarge();
+    template <class T>
+    Object* MoveToOld(Object* young) {
+        return new (AllocateOld<T>()) T(std::move(*static_cast<T*>(young)));
+    }
+    Object* MoveToOld(Object* object);
+    Object* Promote(Object* young);
+    // Marks the object with `epoch` and returns whether it was unmarked.
+    static bool TryMark(Object* object, uint8_t epoch) {
+        return object->mark_.load(std::memory_order_relaxed) != epoch &&
+               object->mark_.exchange(epoch, std::memory_order_relaxed) != epoch;
+    }
+    void Shade(Object* object) {
+        if (not object->is_young_ && not object->is_permanent_ && TryMark(object, epoch_)) {
+            grey_.push_back(object);
+        }
+    }
+    void ShadeRoots();
+    void CollectYoung();
+    void CollectMinorAndMajor();
+    void CompactOld();
+    void StartMarking();
+    bool MarkSlice(size_t budget);
+    void StartSweep();
+    void FinishSweep();
+
 public:
+    static constexpr size_t kDefaultMarkSlice = 4096;
+    // Smaller slices are not worth waking the marker threads for.
+    static constexpr size_t kMinParallelSlice = 1024;
+
     static Heap& Instance() {
         static Heap heap;
         return heap;
@@ -27,24 +267,100 @@ public:
 public:
     template <std::derived_from<Object> T, class... Args>
     T* Make(Args... args) requires std::constructible_from<T, Args...> {
+        static_assert(alignof(T) <= alignof(std::max_align_t));
+        constexpr size_t kSize = SlotSize(sizeof(T));
+        T* object = new (nursery_.Peek(kSize)) T(args...);
+        nursery_.Bump(kSize);
+        object->is_young_ = true;
+        auto& usage = young_[static_cast<size_t>(T::kType)];
+        ++usage.objects;
+        usage.bytes += kSize;
+        if constexpr (kNeedsFinalization<T>) {
+            finalizable_.push_back(object);
+        }
+        return object;
+    };
+
+    // Allocates directly in the old generation, for objects known to be long-lived.
+    template <std::derived_from<Object> T, class... Args>
+    T* MakeOld(Args... args) requires std::constructible_from<T, Args...> {
+        stats_.allocated_bytes += SlotSize(sizeof(T));
+        return new (AllocateOld<T>()) T(args...);
+    }
+
+    template <std::derived_from<Object> T, class... Args>
+    T* MakePermanent(Args... args) requires std::constructible_from<T, Args...> {
         std::unique_ptr<T> ptr = std::make_unique<T>(args...);
         T* raw_ptr = ptr.get();
-        objects_.push_back(std::move(ptr));
+        raw_ptr->is_permanent_ = true;
+        auto& usage = stats_.usage[static_cast<size_t>(T::kType)];
+        ++usage.objects;
+        usage.bytes += sizeof(T);
+        stats_.allocated_bytes += sizeof(T);
+        permanent_.push_back(std::move(ptr));
         return raw_ptr;
-    };
-
-    void Mark(Object* o) {
-        if (o) {
-            o->Mark();
-        }
     }
 
-    void Sweep() {
-        std::erase_if(objects_, [](auto& o) { return not o->is_reachable_; });
-        for (auto& o : objects_) {
-            o->is_reachable_ = false;
+    // Must be called before `holder` is made to reference `value`.
+    void WriteBarrier(Object* holder, Value value) {
+        auto object = value.GetObject();
+        if (not object) {
+            return;
+        }
+        if (marking_) {
+            Shade(object);
+        }
+        if (object->is_young_ && not holder->is_young_ && not holder->is_remembered_) {
+            holder->is_remembered_ = true;
+            remembered_.push_back(holder);
         }
     }
+
+    void AddRootSet(RootSet* roots);
+    void RemoveRootSet(RootSet* roots);
+
+    // Whether enough has been allocated that the next safe point should collect.
+    bool IsCollectionRequested() const { return nursery_.IsOverflowing(); }
+
+    // Runs a minor collection, then starts or continues a major one when it is
+    // due. Anything not reachable from the roots must be dead at this point.
+    void Collect();
+
+    // Sets how many objects a major collection marks per Collect call;
+    // 0 marks the whole heap at once.
+    void SetMarkSlice(size_t budget) { mark_slice_ = budget; }
+    // Sets how many threads, the calling one included, trace large slices.
+    // Defaults to the number of cores. The threads are only started once a
+    // slice needs them.
+    void SetMarkThreads(size_t threads);
+
+    // Makes major collections copy the old generation instead of sweeping it.
+    void SetCompacting(bool compacting) { compacting_ = compacting; }
+    // Empties the nursery and copies every live old object into fresh pages.
+    void Compact();
+
+    HeapStats Stats() const;
 };
 
+// Keeps an object alive and up to date while the handle exists.
+template <std::derived_from<Object> T>
+class Root : public RootSet {
+    T* object_;
+
+public:
+    explicit Root(T* object) : object_(object) {
+        Heap::Instance().AddRootSet(this);
+    }
+    ~Root() {
+        Heap::Instance().RemoveRootSet(this);
+    }
+    Root(const Root&) = delete;
+    Root& operator=(const Root&) = delete;
+
+    T* Get() const { return object_; }
+    T* operator->() const { return object_; }
 
+    void TraceRoots(Tracer& tracer) override {
+        tracer.Visit(object_);
+    }
+};
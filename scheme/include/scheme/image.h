@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include "object.h"
+
+// Saves a global scope and everything it references to a file, so that a new
+// process can start from it instead of evaluating the same definitions again.
+//
+// Objects are written one after another, with references to other objects
+// replaced by their indices in the image. Loading maps the file, recreates
+// every object, and then relocates the references to the new objects. Symbols
+// and builtins are recorded by name and resolved in the loading process;
+// immediates are stored as they are. Objects of the code arena go back to it,
+// the others to the old generation. An image is only meant to be read by the
+// build that wrote it.
+//
+// Loading rejects an image it cannot trust to run: references must have the
+// types the objects expect, and bytecode must stay within its code, its
+// constants, the frames it runs in and the values on the stack.
+class Image {
+    class Writer;
+    class Reader;
+
+public:
+    static void Save(Environment* scope, const std::string& path);
+    // Defines every name saved in the image in `scope`.
+    static void Load(const std::string& path, Environment* scope);
+};
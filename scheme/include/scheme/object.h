@@ -1,208 +1,301 @@
 #pragma once
 
-#include <map>
+#include <atomic>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <span>
+#include <cstdint>
+#include <vector>
 #include "error.h"
+#include "value.h"
 
 class Environment;
+class Frame;
+class Code;
 
-class Object {
-    bool is_reachable_ = false;
+enum class ObjectType { NUMBER, SYMBOL, CELL, BUILTIN, LAMBDA, CODE, FRAME, ENVIRONMENT };
+inline constexpr size_t kObjectTypes = 8;
+
+std::string_view TypeName(ObjectType type);
+
+class Object;
+
+// Visits the references held by an object. The collector uses it both to mark
+// objects and to redirect references to objects it has moved.
+class Tracer {
+public:
+    virtual void Visit(Value& value) = 0;
 
-    void Mark();
+    template <std::derived_from<Object> T>
+    void Visit(T*& object) {
+        Value value = object;
+        Visit(value);
+        object = static_cast<T*>(value.GetObject());
+    }
 
 protected:
-    virtual Object* Eval(Environment*) = 0;
+    ~Tracer() = default;
+};
+
+class Object {
+    const ObjectType type_;
+    // The epoch of the last major collection that marked the object. Atomic
+    // because marker threads race to set it.
+    std::atomic<uint8_t> mark_ = 0;
+    // Set while the object lives in the nursery.
+    bool is_young_ = false;
+    // Set while an old object is in the remembered set.
+    bool is_remembered_ = false;
+    // Set for objects that live outside the collected heap until the process
+    // exits, like symbols and builtins. The collector neither traces nor moves them.
+    bool is_permanent_ = false;
+    // Set for the data that code quotes, which must not change.
+    bool is_constant_ = false;
+    // The promoted copy of a young object that survived a minor collection.
+    Object* forwarding_ = nullptr;
+
+protected:
+    explicit Object(ObjectType type, bool is_permanent = false)
+        : type_(type), is_permanent_(is_permanent) {}
+    // Copies start with a fresh header: they are not yet known to the collector.
+    // A copy of a constant is still constant.
+    Object(const Object& other) : type_(other.type_), is_constant_(other.is_constant_) {}
+
     virtual std::string ToString() const = 0;
-    virtual void MarkDependencies();
+    virtual void Trace(Tracer& tracer);
 
 public:
-    friend Object* Eval(Object* ast, Environment* scope);
-    friend std::string ToString(Object* ast);
+    ObjectType GetType() const { return type_; }
+    bool IsPermanent() const { return is_permanent_; }
+    bool IsConstant() const { return is_constant_; }
+
+    friend std::string ToString(Value ast);
+    friend void MakeConstant(Value datum);
     friend class Heap;
+    friend class CodeArena;
+    friend class Image;
 
 public:
     virtual ~Object() = default;
 };
 
+// Integers that do not fit a fixnum are boxed on the heap.
 class Number : public Object {
     int64_t value_;
 
 public:
+    static constexpr ObjectType kType = ObjectType::NUMBER;
+
     explicit Number(int64_t value);
     int64_t GetValue() const;
 
 protected:
-    Object* Eval(Environment*) override;
     std::string ToString() const override;
 };
 
+// Symbols are interned: every name maps to one canonical Symbol that lives
+// outside the collected heap, so symbols compare by pointer and their ids can
+// index global bindings directly.
 class Symbol : public Object {
     const std::string name_;
+    const size_t id_;
+    // Calls to procedures of this name since the profiler started, kept here
+    // so that counting a call needs no lookup.
+    size_t calls_ = 0;
+
+    friend class Profiler;
 
 public:
-    static Object* True();
-    static Object* False();
+    static constexpr ObjectType kType = ObjectType::SYMBOL;
 
-    explicit Symbol(std::string name);
+    static Symbol* Intern(std::string_view name);
+    static Symbol* FromId(size_t id);
+    static size_t Count();
+
+    Symbol(std::string name, size_t id);
     const std::string& GetName() const;
+    size_t GetId() const;
 
 protected:
-    Object* Eval(Environment*) override;
     std::string ToString() const override;
 };
 
 class Cell : public Object {
-    Object* first_;
-    Object* second_;
+    Value first_;
+    Value second_;
 
 public:
-    Cell(Object* first, Object* second);
-    Object* GetFirst() const;
-    Object* GetSecond() const;
+    static constexpr ObjectType kType = ObjectType::CELL;
+
+    Cell(Value first, Value second);
+    Value GetFirst() const;
+    Value GetSecond() const;
 
-    void SetFirst(Object*);
-    void SetSecond(Object*);
+    void SetFirst(Value);
+    void SetSecond(Value);
 
 protected:
-    void MarkDependencies() override;
-    Object* Eval(Environment*) override;
+    void Trace(Tracer& tracer) override;
     std::string ToString() const override;
 };
 
 class Callable : public Object {
-public:
-    virtual Object* Call(Object* ast, Environment* env) = 0;
+protected:
+    using Object::Object;
 };
 
-class BuiltInSyntax : public Callable {
-    std::function<Object*(Object*, Environment*)> value_;
-
+// A primitive procedure: a plain function that reads its arguments where the
+// VM has evaluated them, on its value stack. The arity is checked before the
+// call, so a function of fixed arity reads exactly the arguments it declares.
+// A primitive that evaluates code, like load, may move the stack and must not
+// read its arguments after that.
+class BuiltIn : public Callable {
 public:
-    explicit BuiltInSyntax(std::function<Object*(Object*, Environment*)> value);
-    Object* Call(Object*, Environment*) override;
+    using Function = Value (*)(std::span<const Value> args);
+    static constexpr size_t kVariadic = SIZE_MAX;
 
-protected:
-    Object* Eval(Environment*) override;
-    std::string ToString() const override;
-};
+private:
+    Symbol* name_;
+    Function function_;
+    size_t min_arity_;
+    size_t max_arity_;
 
-class BuiltInSyntaxTailRecursive : public BuiltInSyntax {
 public:
-    using BuiltInSyntax::BuiltInSyntax;
-    Object* Call(Object*, Environment*) override;
-    Object* CallUntilTail(Object*, Environment*);
-};
+    static constexpr ObjectType kType = ObjectType::BUILTIN;
 
-template <std::derived_from<Object> T = Object>
-class BuiltInProc : public Callable {
-    std::function<Object*(const std::vector<T*>&)> value_;
+    BuiltIn(Symbol* name, Function function, size_t min_arity, size_t max_arity);
+    // The primitive defined under `name`, or nullptr if there is none.
+    static BuiltIn* Find(Symbol* name);
 
-public:
-    BuiltInProc(std::function<Object*(const std::vector<T*>&)> value) : value_(value) {}
-    Object* Call(Object* o, Environment* s) override {
-        return value_(AsVector<T>(o, s));
+    Value Call(std::span<const Value> args) const {
+        if (args.size() < min_arity_ || args.size() > max_arity_) {
+            throw RuntimeError("Invalid function call.");
+        }
+        return function_(args);
     }
 
+    Symbol* GetName() const { return name_; }
+
 protected:
-    Object* Eval(Environment*) override {
-        throw RuntimeError("Trying to evaluate a procedure");
-    }
     std::string ToString() const override {
         return "BuiltInProcedure";
     }
 };
 
 class Lambda : public Callable {
-    Object* ast_;
-    std::vector<Symbol*> formals_;
-    Environment* parent_scope_;
+    Code* code_;
+    Frame* parent_frame_;
 
 public:
-    Lambda(std::vector<Symbol*> formals, Object* ast, Environment*);
-    Object* Call(Object*, Environment*) override;
+    static constexpr ObjectType kType = ObjectType::LAMBDA;
+
+    Lambda(Code* code, Frame* parent_frame);
+    Code* GetCode() const;
+    Frame* GetParentFrame() const;
 
 protected:
-    void MarkDependencies() override;
-    Object* Eval(Environment*) override;
+    void Trace(Tracer& tracer) override;
     std::string ToString() const override;
 };
 
+// Local variables of one procedure activation. Slots are addressed by the
+// compiler as (depth, index) pairs, depth counting enclosing frames.
+class Frame : public Object {
+    std::vector<Value> slots_;
+    Frame* parent_;
+
+public:
+    static constexpr ObjectType kType = ObjectType::FRAME;
+
+    Frame(size_t size, Frame* parent);
+    Frame* GetParent() const;
+    size_t GetSize() const;
+
+    Value Get(size_t depth, size_t index);
+    void Set(size_t depth, size_t index, Value);
+
+protected:
+    void Trace(Tracer& tracer) override;
+    std::string ToString() const override;
+};
+
+// The global scope, with bindings indexed by symbol id.
+// Compiled code caches the slots that global references resolve to, checked
+// against the version of the scope. The version changes whenever the slots
+// may have moved, and no two scopes ever share one, so a cache cannot match
+// a different scope that happens to reuse the address of a dead one.
 class Environment : public Object {
-    std::map<std::string, Object*> names_;
-    Environment* parent_ = nullptr;
+    std::vector<Value> values_;
+    uint64_t version_;
+
+    static uint64_t NextVersion();
 
 public:
+    static constexpr ObjectType kType = ObjectType::ENVIRONMENT;
+
     static Environment* R5RS();
 
-    Object* GetDefinition(const std::string&);
-    void NewDefinition(const std::string&, Object*);
-    void SetDefinition(const std::string&, Object*);
+    Environment();
+    // Copies are new scopes, while a moved scope keeps its slots.
+    Environment(const Environment& other);
+    Environment(Environment&& other) = default;
 
-    void SetParent(Environment*);
+    uint64_t GetVersion() const { return version_; }
+    // The slot holding the value of a defined name, valid while the version
+    // stays the same. Throws like GetDefinition for an undefined one.
+    const Value* GetSlot(Symbol*) const;
+
+    Value GetDefinition(Symbol*);
+    // Like GetDefinition, but returns Unbound for a name that is not defined.
+    Value FindDefinition(Symbol*) const;
+    void NewDefinition(Symbol*, Value);
+    void SetDefinition(Symbol*, Value);
+    // Every bound name with its value.
+    std::vector<std::pair<Symbol*, Value>> GetDefinitions() const;
 
 protected:
-    void MarkDependencies() override;
-    Object* Eval(Environment* ptr) override;
+    void Trace(Tracer& tracer) override;
     std::string ToString() const override;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
-Object* Eval(Object* ast, Environment* scope);
-std::string ToString(Object* ast);
+std::string ToString(Value ast);
+
+// Marks the cells of a quoted datum constant, so that no program can change
+// what its code quotes, whether or not the datum is shared.
+void MakeConstant(Value datum);
+
+// Integers are fixnums when they fit and boxed Numbers otherwise.
+Value MakeInteger(int64_t value);
+int64_t AsInteger(Value value);
 
 ///////////////////////////////////////////////////////////////////////////////
 
 // Runtime type checking and convertion.
-// This can be helpful: https://en.cppreference.com/w/cpp/memory/shared_ptr/pointer_cast
+// Concrete classes carry their ObjectType in kType, so the common checks are a
+// single comparison; abstract bases such as Callable fall back to dynamic_cast.
+// Numbers may be fixnums, so they are read with AsInteger rather than As.
 
 template <std::derived_from<Object> T>
-T* As(Object* obj)  {
-    if constexpr (std::is_same_v<T, Object>) {
-        return obj;
-    }
-    auto ptr = dynamic_cast<T*>(obj);
-    if (ptr == nullptr) {
-        throw RuntimeError("Expected type does not match.");
-    }
-    return ptr;
-}
-
-template <std::derived_from<Object> T>
-bool Is(Object* obj) {
+bool Is(Value value) {
     if constexpr (std::is_same_v<T, Object>) {
         return true;
-    }
-    return dynamic_cast<T*>(obj) != nullptr;
-}
-
-template <size_t N, class T>
-void RequireSize(const std::vector<T*>& v) {
-    if (v.size() != N) {
-        throw RuntimeError("Invalid function call.");
-    }
-}
-
-template <size_t N, class T>
-void RequireSizeAtLeast(const std::vector<T*>& v) {
-    if (v.size() < N) {
-        throw RuntimeError("Invalid function call.");
+    } else if constexpr (std::is_same_v<T, Number>) {
+        return value.IsFixnum() || (value.IsObject() && value.GetObject()->GetType() == T::kType);
+    } else if constexpr (requires { T::kType; }) {
+        return value.IsObject() && value.GetObject()->GetType() == T::kType;
+    } else {
+        return dynamic_cast<T*>(value.GetObject()) != nullptr;
     }
 }
 
 template <std::derived_from<Object> T>
-std::vector<T*> AsVector(Object* o, Environment* env) {
-    std::vector<T*> vec;
-    while (o != nullptr) {
-        if (Is<Cell>(o)) {
-            vec.push_back(As<T>(::Eval(As<Cell>(o)->GetFirst(), env)));
-            o = As<Cell>(o)->GetSecond();
-        } else {
-            vec.push_back(As<T>(::Eval(o, env)));
-            o = nullptr;
-        }
+T* As(Value value) {
+    static_assert(not std::is_same_v<T, Number>, "Use AsInteger for numbers");
+    if (not Is<T>(value)) {
+        throw RuntimeError("Expected type does not match.");
     }
-    return vec;
-}
\ No newline at end of file
+    return static_cast<T*>(value.GetObject());
+}
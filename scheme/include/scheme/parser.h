@@ -1,8 +1,57 @@
 #pragma once
 
 #include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
 
 #include "object.h"
 #include "tokenizer.h"
 
-Object* Read(Tokenizer* tokenizer);
\ No newline at end of file
+inline constexpr size_t kDefaultMaxDepth = 1000;
+
+// Reads one datum. Lists and quotes may be nested at most `max_depth` deep,
+// which keeps the recursive passes over the datum within the C++ stack.
+Value Read(Tokenizer* tokenizer, size_t max_depth = kDefaultMaxDepth);
+
+// Splits source text into top-level datums and reads each one as soon as all
+// of it is there. Input can be fed in chunks that split datums anywhere, and
+// the scan resumes where the previous chunk ended instead of starting over.
+// An atom at the end of the input is only complete once something follows it
+// or Finish is called, as the next chunk could extend it.
+class Reader {
+    std::string buffer_;
+    std::string_view input_;
+    // The datum being scanned starts at start_, and the input before pos_ has
+    // been scanned already.
+    size_t start_ = 0;
+    size_t pos_ = 0;
+    size_t depth_ = 0;
+    bool in_atom_ = false;
+    // Inside a symbol written between bars.
+    bool in_bars_ = false;
+    bool finished_ = false;
+    size_t max_depth_ = kDefaultMaxDepth;
+
+    Value Parse(size_t end);
+
+public:
+    // Reads input fed in chunks.
+    Reader() = default;
+    // Reads the whole source in place. It must outlive the reader.
+    explicit Reader(std::string_view source);
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    void Feed(std::string_view chunk);
+    // Marks the end of the input: what remains of it is read as a datum.
+    void Finish();
+    // Returns the next complete datum, or nullopt until more input arrives.
+    // A malformed datum is dropped and reported as a SyntaxError.
+    std::optional<Value> Next();
+    // Whether some of the input is not read yet, apart from blanks.
+    bool HasPartial() const;
+    void Clear();
+
+    void SetMaxDepth(size_t max_depth) { max_depth_ = max_depth; }
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "object.h"
+
+// A sampling profiler for Scheme code. While it runs, the VM reports every
+// procedure call and return, which keeps a call stack of procedure names. A
+// SIGPROF timer copies that stack into a preallocated buffer at regular
+// intervals of CPU time; the samples give the share of time spent in each
+// procedure.
+//
+// The stack holds symbols because they never move, unlike heap objects.
+// Procedures are named after the definition that created them, anonymous
+// lambdas are all called `lambda`. Only the outermost kMaxDepth calls of a
+// deeper stack are recorded.
+class Profiler {
+    static constexpr size_t kMaxDepth = 1024;
+    static constexpr size_t kSampleCapacity = 1 << 20;
+
+    std::array<Symbol*, kMaxDepth> stack_{};
+    std::atomic<size_t> depth_ = 0;
+    bool running_ = false;
+    // CPU time of the process when the profiler started, and the CPU time
+    // it ran for once it stopped.
+    std::chrono::nanoseconds start_time_{0};
+    std::chrono::nanoseconds cpu_time_{0};
+
+    // Samples are stored one after another, each one ending with nullptr.
+    std::vector<Symbol*> samples_;
+    std::atomic<size_t> samples_size_ = 0;
+    std::atomic<size_t> dropped_ = 0;
+    struct sigaction previous_action_ {};
+
+    Profiler() = default;
+    Profiler(const Profiler&) = delete;
+
+    static void OnSignal(int);
+    void TakeSample();
+    void CountCall(Symbol* name) {
+        ++name->calls_;
+    }
+    std::chrono::nanoseconds GetCpuTime() const;
+
+public:
+    static constexpr std::chrono::microseconds kDefaultInterval{1000};
+
+    struct Procedure {
+        std::string name;
+        size_t calls = 0;
+        std::chrono::nanoseconds inclusive{0};
+        std::chrono::nanoseconds exclusive{0};
+    };
+
+    static Profiler& Instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // Discards the previous profile and starts sampling every `interval` of
+    // CPU time.
+    void Start(std::chrono::microseconds interval = kDefaultInterval);
+    void Stop();
+    bool IsRunning() const { return running_; }
+
+    // Only runs that start while the profiler is running report their calls,
+    // so the hooks do not check that again.
+    void Enter(Symbol* name) {
+        auto depth = depth_.load(std::memory_order_relaxed);
+        if (depth < kMaxDepth) {
+            stack_[depth] = name;
+        }
+        // The signal handler runs on this thread, so a compiler fence is
+        // enough to publish the entry before the new depth.
+        std::atomic_signal_fence(std::memory_order_release);
+        depth_.store(depth + 1, std::memory_order_relaxed);
+        CountCall(name);
+    }
+    // A tail call replaces the entry of the procedure that makes it.
+    void TailCall(Symbol* name) {
+        auto depth = depth_.load(std::memory_order_relaxed);
+        if (depth > 0 && depth <= kMaxDepth) {
+            stack_[depth - 1] = name;
+        }
+        CountCall(name);
+    }
+    void Leave() {
+        depth_.store(depth_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    }
+    size_t GetDepth() const { return depth_.load(std::memory_order_relaxed); }
+    // Drops the calls above `depth`, the ones an exception has left.
+    void Unwind(size_t depth) {
+        if (running_) {
+            depth_.store(depth, std::memory_order_relaxed);
+        }
+    }
+
+    // Writes one line per distinct stack, outermost call first, in the
+    // folded format that flamegraph tools read: `main;f;g 12`.
+    void WriteFolded(std::ostream& out) const;
+    // Procedures sorted by exclusive time, the ones never sampled last. The
+    // CPU time the profiler ran for is split between them by their share of
+    // the samples: the timer only fires on a scheduler tick, which is usually
+    // longer than the requested interval.
+    std::vector<Procedure> GetProcedures() const;
+    size_t GetSampleCount() const;
+    size_t GetDroppedSamples() const { return dropped_; }
+};
@@ -1,38 +1,74 @@
 #pragma once
 
 #include <map>
+#include <optional>
 #include <string>
+#include <string_view>
 #include "object.h"
 #include "heap.h"
+#include "parser.h"
+#include "code_arena.h"
+#include "vm.h"
 
 class ArgList {
-    std::vector<Object*> vec_;
+    std::vector<Value> vec_;
     bool is_proper_;
 
 public:
-    explicit ArgList(Object* ast);
+    explicit ArgList(Value ast);
 
     bool IsProper() const;
-    Object* At(size_t i) const;
-
-    template <class T = Object>
-    T* EvalAs(size_t i, Environment* scope) {
-        return As<T>(Eval(i, scope));
-    }
-
-    Object* Eval(size_t i, Environment* scope) {
-        return ::Eval(At(i), scope);
-    }
+    Value At(size_t i) const;
 
     ArgList& ExpectSize(size_t size);
     ArgList& ExpectSizeAtLeast(size_t size);
     std::string ToString();
 
-    auto Size() { return vec_.size(); }
+    auto Size() const { return vec_.size(); }
 };
 
 class Interpreter {
-    Environment* global_scope_ = Environment::R5RS();
+    Root<Environment> global_scope_;
+    VM vm_;
+    Reader reader_;
+
+    static thread_local Interpreter* current_;
+
+    Value Eval(Value ast, CodeArena* arena = nullptr);
+    std::string EvalAll(Reader* reader, CodeArena* arena = nullptr);
+
 public:
+    Interpreter();
+    ~Interpreter();
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
+
+    // Evaluates every form in the string in order and returns the value of
+    // the last one. All of them are read first, so a SyntaxError anywhere,
+    // like a form left unfinished at the end, leaves every one unevaluated.
+    // A form that fails to run leaves the ones before it evaluated.
     std::string Run(const std::string&);
+    // Evaluates every form in the file like Run does. The file is mapped into
+    // memory and tokenized in place. Its procedure bodies and constants are
+    // kept in the code arena, and the top-level code, which runs once, is
+    // left to the collector.
+    std::string RunFile(const std::string& path);
+
+    // Writes the global scope and everything it references to an image file.
+    void SaveImage(const std::string& path);
+    // Defines every name saved in an image file, as if the code that defined
+    // them had been run again.
+    void LoadImage(const std::string& path);
+
+    // Appends a chunk of input for RunNext, such as a line from a terminal.
+    // Forms may span several chunks.
+    void Feed(std::string_view chunk);
+    // Evaluates the next form that Feed has completed and returns its value,
+    // or nullopt if there is none yet. A form that fails is dropped.
+    std::optional<std::string> RunNext();
+    // Whether Feed has started a form that is not complete yet.
+    bool HasPartialInput() const;
+
+    // The interpreter that is evaluating code on this thread, if any.
+    static Interpreter* Current() { return current_; }
 };
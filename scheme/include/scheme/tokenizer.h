@@ -1,11 +1,17 @@
 #pragma once
 
+#include <cstdint>
 #include <variant>
 #include <optional>
 #include <istream>
+#include <string>
+#include <string_view>
 
+// Refers to the tokenizer input and stays valid until the tokenizer moves on.
+// A name written between bars, like |lib/list.scm|, may hold any character
+// but '|'; the bars are kept, so that |#t| is not mistaken for #t.
 struct SymbolToken {
-    std::string name;
+    std::string_view name;
 
     bool operator==(const SymbolToken& other) const;
 };
@@ -21,7 +27,7 @@ struct DotToken {
 enum class BracketToken { OPEN, CLOSE };
 
 struct ConstantToken {
-    int value;
+    int64_t value;
 
     bool operator==(const ConstantToken& other) const;
 };
@@ -30,7 +36,12 @@ using Token = std::variant<ConstantToken, BracketToken, SymbolToken, QuoteToken,
 
 class Tokenizer {
 public:
+    // Reads the stream a character at a time as tokens are requested, so
+    // input appended to it later is seen.
     Tokenizer(std::istream* in);
+    // Scans the source in place, without copying it. It must outlive the
+    // tokenizer.
+    Tokenizer(std::string_view source);
 
     bool IsEnd();
 
@@ -39,9 +50,16 @@ public:
     Token GetToken();
 
 private:
-    ConstantToken ReadConstant();
-    SymbolToken ReadSymbol();
+    // Returns the character at `pos_` or EOF, reading it from the stream if needed.
+    int Peek();
+    ConstantToken ReadConstant(size_t start);
+    SymbolToken ReadSymbol(size_t start);
+    SymbolToken ReadVerbatimSymbol(size_t start);
 
-    std::istream* in_;
+    std::istream* in_ = nullptr;
+    // What was read from the stream since the current token started.
+    std::string buffer_;
+    std::string_view source_;
+    size_t pos_ = 0;
     std::optional<Token> current_token_;
-};
\ No newline at end of file
+};
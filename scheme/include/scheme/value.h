@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class Object;
+
+// A Scheme value: either a pointer to a heap Object or an immediate that
+// never touches the heap. The two low bits tag the representation:
+//   ..00  Object pointer; all-zero bits stand for the empty list
+//   ..01  fixnum, a 62-bit signed integer kept in the upper bits
+//   ..10  other immediates: #f, #t and the unbound-variable marker
+class Value {
+    uintptr_t bits_ = 0;
+
+    static constexpr uintptr_t kTagMask = 0b11;
+    static constexpr uintptr_t kFixnumTag = 0b01;
+    static constexpr uintptr_t kImmediateTag = 0b10;
+
+    static constexpr uintptr_t kFalse = 0b0010;
+    static constexpr uintptr_t kTrue = 0b0110;
+    static constexpr uintptr_t kUnbound = 0b1010;
+
+public:
+    static constexpr int64_t kFixnumMin = -(int64_t{1} << 61);
+    static constexpr int64_t kFixnumMax = (int64_t{1} << 61) - 1;
+
+    constexpr Value() = default;
+    constexpr Value(std::nullptr_t) {}
+    Value(Object* object) : bits_(reinterpret_cast<uintptr_t>(object)) {}
+
+    static constexpr bool FitsFixnum(int64_t value) {
+        return kFixnumMin <= value && value <= kFixnumMax;
+    }
+    static constexpr Value Fixnum(int64_t value) {
+        return FromBits((static_cast<uintptr_t>(value) << 2) | kFixnumTag);
+    }
+    static constexpr Value Boolean(bool value) {
+        return FromBits(value ? kTrue : kFalse);
+    }
+    static constexpr Value True() { return FromBits(kTrue); }
+    static constexpr Value False() { return FromBits(kFalse); }
+    // Marks a variable slot whose definition has not been evaluated yet.
+    static constexpr Value Unbound() { return FromBits(kUnbound); }
+
+    constexpr bool IsNull() const { return bits_ == 0; }
+    constexpr bool IsObject() const { return bits_ != 0 && (bits_ & kTagMask) == 0; }
+    constexpr bool IsFixnum() const { return (bits_ & kTagMask) == kFixnumTag; }
+    constexpr bool IsBoolean() const { return bits_ == kTrue || bits_ == kFalse; }
+    // Everything except #f counts as true.
+    constexpr bool IsTrue() const { return bits_ != kFalse; }
+
+    constexpr int64_t GetFixnum() const { return static_cast<int64_t>(bits_) >> 2; }
+    // The referenced object, or nullptr for the empty list.
+    Object* GetObject() const { return IsObject() ? reinterpret_cast<Object*>(bits_) : nullptr; }
+
+    // Equal exactly for equal values, so it can serve as a hash key.
+    constexpr uintptr_t GetBits() const { return bits_; }
+    static constexpr Value FromBits(uintptr_t bits) {
+        Value v;
+        v.bits_ = bits;
+        return v;
+    }
+
+    constexpr bool operator==(const Value&) const = default;
+
+    // Like the pointers it replaces: false only for the empty list.
+    constexpr explicit operator bool() const { return bits_ != 0; }
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include "bytecode.h"
+#include "heap.h"
+#include "profiler.h"
+
+// Calls are the safe points of evaluation: there the whole state of the
+// computation is in the value stack and the call frames, which the VM
+// reports to the heap as roots.
+//
+// An interpreter keeps one VM for all its evaluations. Arguments are evaluated
+// onto the value stack, and builtins read them there, so a call copies nothing.
+// Run may be reentered by a builtin such as load; the inner run leaves the
+// stacks as it found them, whether it returns or throws.
+class VM : public RootSet {
+    static constexpr size_t kStackReserve = 1024;
+
+    struct CallFrame {
+        Code* code;
+        size_t pc;
+        Frame* frame;
+        Lambda* callee;
+        size_t base;
+    };
+
+    Environment* global_scope_;
+    Profiler& profiler_ = Profiler::Instance();
+    std::vector<Value> stack_;
+    std::vector<CallFrame> frames_;
+
+    Value Pop();
+    void SafePoint();
+    // The loop is compiled twice, with calls reported to the profiler and
+    // without, so runs that are not profiled carry no hooks at all. It
+    // returns once the frames are back to `frames`.
+    template <bool kProfiling>
+    Value Execute(size_t frames);
+    template <bool kProfiling>
+    void Call(uint32_t argc, bool tail);
+    uint32_t SpreadApplyArguments(uint32_t argc);
+    Frame* BindArguments(Lambda* lambda, uint32_t argc);
+
+public:
+    explicit VM(Environment* global_scope);
+    ~VM();
+    VM(const VM&) = delete;
+    VM& operator=(const VM&) = delete;
+
+    Value Run(Code* code);
+
+    void TraceRoots(Tracer& tracer) override;
+};
@@ -0,0 +1,35 @@
+#include <scheme/bytecode.h>
+#include <scheme/heap.h>
+
+Code::Code(size_t arity, size_t frame_size)
+    : Object(kType), arity_(arity), frame_size_(frame_size) {}
+
+size_t Code::Emit(OpCode op, uint32_t arg, uint16_t depth) {
+    instructions_.push_back(Instruction{op, depth, arg});
+    return instructions_.size() - 1;
+}
+
+void Code::Patch(size_t at, uint32_t target) {
+    instructions_[at].arg = target;
+}
+
+size_t Code::Size() const {
+    return instructions_.size();
+}
+
+uint32_t Code::AddConstant(Value v) {
+    Heap::Instance().WriteBarrier(this, v);
+    constants_.push_back(v);
+    caches_.emplace_back();
+    return constants_.size() - 1;
+}
+
+void Code::Trace(Tracer& tracer) {
+    for (auto& c : constants_) {
+        tracer.Visit(c);
+    }
+}
+
+std::string Code::ToString() const {
+    return "Code";
+}
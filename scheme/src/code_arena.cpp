@@ -0,0 +1,99 @@
+#include <scheme/code_arena.h>
+
+#include <stdexcept>
+
+CodeArena::~CodeArena() {
+    for (auto object : finalizable_) {
+        object->~Object();
+    }
+}
+
+void* CodeArena::Allocate(size_t size) {
+    size = (size + kGranularity - 1) / kGranularity * kGranularity;
+    if (static_cast<size_t>(limit_ - top_) < size) {
+        auto& chunk = chunks_.emplace_back(new std::byte[kChunkSize]);
+        top_ = chunk.get();
+        limit_ = top_ + kChunkSize;
+    }
+    auto memory = top_;
+    top_ += size;
+    size_ += size;
+    return memory;
+}
+
+Value CodeArena::InternCell(Value first, Value second) {
+    auto key = std::make_pair(first.GetBits(), second.GetBits());
+    auto& cell = cells_[key];
+    if (not cell) {
+        cell = Make<Cell>(first, second);
+        cell->is_constant_ = true;
+    }
+    return cell;
+}
+
+// Codes are equal when they behave the same: they have the same name, frame
+// layout and instructions, and their constants, interned already, are the
+// same objects.
+Code* CodeArena::InternCode(Code* code) {
+    std::string key;
+    auto put = [&key](auto value) {
+        key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    put(code->GetName());
+    put(code->GetArity());
+    put(code->GetFrameSize());
+    put(code->Size());
+    for (size_t pc = 0; pc < code->Size(); ++pc) {
+        put(code->At(pc).op);
+        put(code->At(pc).depth);
+        put(code->At(pc).arg);
+    }
+    for (size_t i = 0; i < code->ConstantCount(); ++i) {
+        put(code->GetConstant(i).GetBits());
+    }
+    auto& shared = codes_[key];
+    if (not shared) {
+        shared = Make<Code>(code->GetArity(), code->GetFrameSize());
+        shared->SetName(code->GetName());
+        for (size_t pc = 0; pc < code->Size(); ++pc) {
+            shared->Emit(code->At(pc).op, code->At(pc).arg, code->At(pc).depth);
+        }
+        for (size_t i = 0; i < code->ConstantCount(); ++i) {
+            shared->AddConstant(code->GetConstant(i));
+        }
+    }
+    return shared;
+}
+
+// Lists are interned from the last cell to the first, so only their nesting
+// takes C++ stack, which the reader limits.
+Value CodeArena::Intern(Value datum) {
+    auto object = datum.GetObject();
+    if (not object || object->is_permanent_) {
+        return datum;
+    }
+    if (Is<Code>(datum)) {
+        return InternCode(As<Code>(datum));
+    }
+    if (Is<Number>(datum)) {
+        auto value = AsInteger(datum);
+        auto& number = numbers_[value];
+        if (not number) {
+            number = Make<Number>(value);
+        }
+        return number;
+    }
+    if (not Is<Cell>(datum)) {
+        throw std::logic_error("Only data can be constants");
+    }
+    std::vector<Cell*> cells;
+    for (; Is<Cell>(datum) && not datum.GetObject()->is_permanent_;
+         datum = As<Cell>(datum)->GetSecond()) {
+        cells.push_back(As<Cell>(datum));
+    }
+    auto list = Intern(datum);
+    for (auto it = cells.rbegin(); it != cells.rend(); ++it) {
+        list = InternCell(Intern((*it)->GetFirst()), list);
+    }
+    return list;
+}
@@ -0,0 +1,351 @@
+#include <scheme/compiler.h>
+#include <scheme/code_arena.h>
+#include <scheme/heap.h>
+#include <scheme/scheme.h>
+
+#include <optional>
+
+// Names of the slots of one procedure frame, innermost first in the chain.
+struct Scope {
+    std::vector<Symbol*> locals;
+    const Scope* parent;
+
+    std::optional<size_t> Find(Symbol* name) const {
+        for (size_t i = 0; i < locals.size(); ++i) {
+            if (locals[i] == name) {
+                return i;
+            }
+        }
+        return std::nullopt;
+    }
+
+    void Add(Symbol* name) {
+        if (not Find(name)) {
+            locals.push_back(name);
+        }
+    }
+
+    // Whether the name is bound here or in a scope around this one.
+    bool Binds(Symbol* name) const {
+        for (auto scope = this; scope; scope = scope->parent) {
+            if (scope->Find(name)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+struct Keywords {
+    Symbol* quote = Symbol::Intern("quote");
+    Symbol* if_ = Symbol::Intern("if");
+    Symbol* and_ = Symbol::Intern("and");
+    Symbol* or_ = Symbol::Intern("or");
+    Symbol* begin = Symbol::Intern("begin");
+    Symbol* lambda = Symbol::Intern("lambda");
+    Symbol* define = Symbol::Intern("define");
+    Symbol* set = Symbol::Intern("set!");
+
+    static const Keywords& Get() {
+        static const Keywords keywords;
+        return keywords;
+    }
+};
+
+struct Address {
+    uint16_t depth;
+    uint32_t index;
+};
+
+// Collects the names defined directly in a procedure body, not descending into
+// nested lambdas or quoted data, so that they get slots in its frame. Like the
+// compiler, it takes a keyword bound as a local variable for that variable.
+void CollectDefinitions(Value form, Scope* scope) {
+    if (not Is<Cell>(form)) {
+        return;
+    }
+    auto args = ArgList(form);
+    auto& keywords = Keywords::Get();
+    if (Is<Symbol>(args.At(0)) && not scope->Binds(As<Symbol>(args.At(0)))) {
+        auto keyword = As<Symbol>(args.At(0));
+        if (keyword == keywords.quote || keyword == keywords.lambda) {
+            return;
+        }
+        if (keyword == keywords.define && args.Size() > 1) {
+            auto declaration = args.At(1);
+            if (Is<Symbol>(declaration)) {
+                scope->Add(As<Symbol>(declaration));
+            } else if (Is<Cell>(declaration) && Is<Symbol>(As<Cell>(declaration)->GetFirst())) {
+                scope->Add(As<Symbol>(As<Cell>(declaration)->GetFirst()));
+                return;
+            }
+        }
+    }
+    for (size_t i = 0; i < args.Size(); ++i) {
+        CollectDefinitions(args.At(i), scope);
+    }
+}
+
+class Compiler {
+    Code* code_;
+    const Scope* scope_;
+    CodeArena* arena_;
+
+public:
+    Compiler(Code* code, const Scope* scope, CodeArena* arena)
+        : code_(code), scope_(scope), arena_(arena) {}
+
+    void CompileExpression(Value ast, bool tail);
+    void CompileSequence(const ArgList& forms, size_t from, bool tail);
+
+private:
+    bool CompileSpecialForm(Symbol* keyword, const ArgList& args, bool tail);
+    void CompileApplication(Value ast, bool tail);
+
+    void CompileQuote(const ArgList& args);
+    void CompileIf(const ArgList& args, bool tail);
+    void CompileAnd(const ArgList& args, bool tail);
+    void CompileOr(const ArgList& args, bool tail);
+    void CompileLambda(const ArgList& args, Symbol* name);
+    void CompileDefine(const ArgList& args);
+    void CompileSet(const ArgList& args);
+
+    // Compiles a procedure body into a separate Code and emits MAKE_LAMBDA for it.
+    void EmitLambda(Symbol* name, std::vector<Symbol*> formals, const ArgList& body, size_t from);
+    void EmitConstant(Value v);
+    std::optional<Address> Resolve(Symbol* name) const;
+};
+
+void Compiler::CompileExpression(Value ast, bool tail) {
+    if (ast.IsNull()) {
+        throw RuntimeError("() cannot be evaluated");
+    }
+    if (Is<Symbol>(ast)) {
+        if (auto address = Resolve(As<Symbol>(ast))) {
+            code_->Emit(OpCode::LOAD_LOCAL, address->index, address->depth);
+        } else {
+            code_->Emit(OpCode::LOAD_GLOBAL, code_->AddConstant(ast));
+        }
+        return;
+    }
+    if (not Is<Cell>(ast)) {
+        EmitConstant(ast);
+        return;
+    }
+    auto head = As<Cell>(ast)->GetFirst();
+    // A local variable shadows the special form of the same name.
+    if (Is<Symbol>(head) && not Resolve(As<Symbol>(head))) {
+        auto args = ArgList(As<Cell>(ast)->GetSecond());
+        if (CompileSpecialForm(As<Symbol>(head), args, tail)) {
+            return;
+        }
+    }
+    CompileApplication(ast, tail);
+}
+
+void Compiler::CompileSequence(const ArgList& forms, size_t from, bool tail) {
+    for (size_t i = from; i < forms.Size(); ++i) {
+        bool last = i + 1 == forms.Size();
+        CompileExpression(forms.At(i), tail && last);
+        if (not last) {
+            code_->Emit(OpCode::POP);
+        }
+    }
+}
+
+bool Compiler::CompileSpecialForm(Symbol* keyword, const ArgList& args, bool tail) {
+    auto& keywords = Keywords::Get();
+    if (keyword == keywords.quote) {
+        CompileQuote(args);
+    } else if (keyword == keywords.if_) {
+        CompileIf(args, tail);
+    } else if (keyword == keywords.and_) {
+        CompileAnd(args, tail);
+    } else if (keyword == keywords.or_) {
+        CompileOr(args, tail);
+    } else if (keyword == keywords.begin) {
+        if (args.Size() == 0 || not args.IsProper()) {
+            throw SyntaxError("Invalid begin expression.");
+        }
+        CompileSequence(args, 0, tail);
+    } else if (keyword == keywords.lambda) {
+        CompileLambda(args, keywords.lambda);
+    } else if (keyword == keywords.define) {
+        CompileDefine(args);
+    } else if (keyword == keywords.set) {
+        CompileSet(args);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void Compiler::CompileApplication(Value ast, bool tail) {
+    auto form = ArgList(ast);
+    if (not form.IsProper()) {
+        throw SyntaxError("Invalid procedure call.");
+    }
+    for (size_t i = 0; i < form.Size(); ++i) {
+        CompileExpression(form.At(i), false);
+    }
+    code_->Emit(tail ? OpCode::TAIL_CALL : OpCode::CALL, form.Size() - 1);
+}
+
+void Compiler::CompileQuote(const ArgList& args) {
+    if (args.Size() != 1 || not args.IsProper()) {
+        throw SyntaxError("Invalid quote expression.");
+    }
+    EmitConstant(args.At(0));
+}
+
+void Compiler::CompileIf(const ArgList& args, bool tail) {
+    if ((args.Size() != 2 && args.Size() != 3) || not args.IsProper()) {
+        throw SyntaxError("Wrong number of parameters");
+    }
+    CompileExpression(args.At(0), false);
+    auto to_else = code_->Emit(OpCode::JUMP_IF_FALSE);
+    CompileExpression(args.At(1), tail);
+    auto to_end = code_->Emit(OpCode::JUMP);
+    code_->Patch(to_else, code_->Size());
+    if (args.Size() == 3) {
+        CompileExpression(args.At(2), tail);
+    } else {
+        EmitConstant(nullptr);
+    }
+    code_->Patch(to_end, code_->Size());
+}
+
+void Compiler::CompileAnd(const ArgList& args, bool tail) {
+    if (args.Size() == 0) {
+        EmitConstant(Value::True());
+        return;
+    }
+    std::vector<size_t> to_end;
+    for (size_t i = 0; i + 1 < args.Size(); ++i) {
+        CompileExpression(args.At(i), false);
+        to_end.push_back(code_->Emit(OpCode::JUMP_IF_FALSE_KEEP));
+    }
+    CompileExpression(args.At(args.Size() - 1), tail);
+    for (auto jump : to_end) {
+        code_->Patch(jump, code_->Size());
+    }
+}
+
+void Compiler::CompileOr(const ArgList& args, bool tail) {
+    if (args.Size() == 0) {
+        EmitConstant(Value::False());
+        return;
+    }
+    std::vector<size_t> to_end;
+    for (size_t i = 0; i + 1 < args.Size(); ++i) {
+        CompileExpression(args.At(i), false);
+        to_end.push_back(code_->Emit(OpCode::JUMP_IF_TRUE_KEEP));
+    }
+    CompileExpression(args.At(args.Size() - 1), tail);
+    for (auto jump : to_end) {
+        code_->Patch(jump, code_->Size());
+    }
+}
+
+void Compiler::CompileLambda(const ArgList& args, Symbol* name) {
+    if (args.Size() < 2 || not args.IsProper()) {
+        throw SyntaxError("Invalid lambda expression.");
+    }
+    auto decl = ArgList(args.At(0));
+    if (not decl.IsProper()) {
+        throw SyntaxError("Invalid lambda expression.");
+    }
+    std::vector<Symbol*> formals;
+    for (size_t i = 0; i < decl.Size(); ++i) {
+        formals.push_back(As<Symbol>(decl.At(i)));
+    }
+    EmitLambda(name, std::move(formals), args, 1);
+}
+
+void Compiler::CompileDefine(const ArgList& args) {
+    if (args.Size() < 2 || not args.IsProper()) {
+        throw SyntaxError("Invalid define expression.");
+    }
+    auto declaration = args.At(0);
+    Symbol* name;
+    if (Is<Symbol>(declaration)) {
+        if (args.Size() != 2) {
+            throw SyntaxError("Invalid define expression.");
+        }
+        name = As<Symbol>(declaration);
+        auto value = args.At(1);
+        // (define f (lambda ...)) names the procedure like (define (f ...) ...).
+        auto lambda = Keywords::Get().lambda;
+        if (Is<Cell>(value) && As<Cell>(value)->GetFirst() == lambda && not Resolve(lambda)) {
+            CompileLambda(ArgList(As<Cell>(value)->GetSecond()), name);
+        } else {
+            CompileExpression(value, false);
+        }
+    } else {
+        auto decl = ArgList(As<Cell>(declaration));
+        if (not decl.IsProper()) {
+            throw SyntaxError("Invalid define expression.");
+        }
+        name = As<Symbol>(decl.At(0));
+        std::vector<Symbol*> formals;
+        for (size_t i = 1; i < decl.Size(); ++i) {
+            formals.push_back(As<Symbol>(decl.At(i)));
+        }
+        EmitLambda(name, std::move(formals), args, 1);
+    }
+    if (scope_) {
+        code_->Emit(OpCode::DEFINE_LOCAL, *scope_->Find(name));
+    } else {
+        code_->Emit(OpCode::DEFINE_GLOBAL, code_->AddConstant(name));
+    }
+}
+
+void Compiler::CompileSet(const ArgList& args) {
+    if (args.Size() != 2 || not args.IsProper()) {
+        throw SyntaxError("Invalid set! expression.");
+    }
+    auto name = As<Symbol>(args.At(0));
+    CompileExpression(args.At(1), false);
+    if (auto address = Resolve(name)) {
+        code_->Emit(OpCode::SET_LOCAL, address->index, address->depth);
+    } else {
+        code_->Emit(OpCode::SET_GLOBAL, code_->AddConstant(name));
+    }
+}
+
+void Compiler::EmitLambda(Symbol* name, std::vector<Symbol*> formals, const ArgList& body,
+                          size_t from) {
+    auto arity = formals.size();
+    Scope scope{std::move(formals), scope_};
+    for (size_t i = from; i < body.Size(); ++i) {
+        CollectDefinitions(body.At(i), &scope);
+    }
+    auto code = Heap::Instance().Make<Code>(arity, scope.locals.size());
+    code->SetName(name);
+    Compiler(code, &scope, arena_).CompileSequence(body, from, true);
+    code->Emit(OpCode::RETURN);
+    code_->Emit(OpCode::MAKE_LAMBDA, code_->AddConstant(arena_ ? arena_->Intern(code) : code));
+}
+
+void Compiler::EmitConstant(Value v) {
+    auto constant = arena_ ? arena_->Intern(v) : v;
+    MakeConstant(constant);
+    code_->Emit(OpCode::CONSTANT, code_->AddConstant(constant));
+}
+
+std::optional<Address> Compiler::Resolve(Symbol* name) const {
+    uint16_t depth = 0;
+    for (auto scope = scope_; scope; scope = scope->parent, ++depth) {
+        if (auto index = scope->Find(name)) {
+            return Address{depth, static_cast<uint32_t>(*index)};
+        }
+    }
+    return std::nullopt;
+}
+
+Code* Compile(Value ast, CodeArena* arena) {
+    auto code = Heap::Instance().Make<Code>();
+    Compiler(code, nullptr, arena).CompileExpression(ast, true);
+    code->Emit(OpCode::RETURN);
+    return code;
+}
@@ -0,0 +1,776 @@
+#include <scheme/heap.h>
+#include <scheme/bytecode.h>
+
+#include <algorithm>
+#include <bit>
+#include <bitset>
+#include <condition_variable>
+#include <csignal>
+#include <mutex>
+#include <thread>
+
+#include <sys/mman.h>
+
+namespace {
+
+template <class T>
+void ResetBuffer(std::vector<T>* buffer, size_t capacity) {
+    buffer->clear();
+    if (buffer->capacity() > capacity) {
+        std::vector<T>().swap(*buffer);
+        buffer->reserve(capacity);
+    }
+}
+
+// Adds the time from its creation to its destruction to a total.
+class Stopwatch {
+    std::chrono::nanoseconds* total_;
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+
+public:
+    explicit Stopwatch(std::chrono::nanoseconds* total) : total_(total) {}
+    ~Stopwatch() {
+        *total_ += std::chrono::steady_clock::now() - start_;
+    }
+};
+
+void CountFreed(HeapStats* stats, Object* object, size_t size) {
+    auto& usage = stats->usage[static_cast<size_t>(object->GetType())];
+    --usage.objects;
+    usage.bytes -= size;
+}
+
+void Unmap(HeapStats* stats, void* memory, size_t size) {
+    ASAN_UNPOISON_MEMORY_REGION(memory, size);
+    munmap(memory, size);
+    --stats->pages;
+    stats->page_bytes -= size;
+}
+
+}  // namespace
+
+Heap::Nursery::Nursery() {
+    AddChunk();
+}
+
+void Heap::Nursery::AddChunk() {
+    chunks_.push_back(std::make_unique<std::byte[]>(kChunkSize));
+    top_ = chunks_.back().get();
+    limit_ = top_ + kChunkSize;
+}
+
+void Heap::Nursery::Reset() {
+    chunks_.resize(1);
+    top_ = chunks_.front().get();
+    limit_ = top_ + kChunkSize;
+    ASAN_POISON_MEMORY_REGION(top_, kChunkSize);
+}
+
+struct Heap::Pool::Page {
+    static constexpr size_t kSize = 64 * 1024;
+    static constexpr size_t kMaxSlots = kSize / kGranularity;
+
+    Page* next_available = nullptr;
+    // Freed slots, each holding a pointer to the next one.
+    void* free = nullptr;
+    // Slots past this one have never been handed out.
+    size_t unused = 0;
+    size_t live = 0;
+    size_t slot_size;
+    size_t capacity;
+    std::bitset<kMaxSlots> used;
+
+    explicit Page(size_t slot_size)
+        : slot_size(slot_size), capacity((kSize - SlotsOffset()) / slot_size) {}
+
+    static constexpr size_t SlotsOffset() {
+        return (sizeof(Page) + kGranularity - 1) / kGranularity * kGranularity;
+    }
+    std::byte* Slot(size_t index) {
+        return reinterpret_cast<std::byte*>(this) + SlotsOffset() + index * slot_size;
+    }
+    size_t IndexOf(void* slot) {
+        return (static_cast<std::byte*>(slot) - Slot(0)) / slot_size;
+    }
+};
+
+Heap::Pool::~Pool() {
+    for (auto page : pages_) {
+        for (size_t i = 0; i < page->unused; ++i) {
+            if (page->used[i]) {
+                auto object = reinterpret_cast<Object*>(page->Slot(i));
+                CountFreed(stats_, object, slot_size_);
+                object->~Object();
+            }
+        }
+        Unmap(stats_, page, Page::kSize);
+    }
+}
+
+void Heap::Pool::AddPage() {
+    void* memory = mmap(nullptr, Page::kSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    ++stats_->pages;
+    stats_->page_bytes += Page::kSize;
+    auto page = new (memory) Page(slot_size_);
+    pages_.push_back(page);
+    page->next_available = available_;
+    available_ = page;
+}
+
+void* Heap::Pool::Allocate() {
+    while (not available_ && unswept_ > 0) {
+        SweepPage();
+    }
+    if (not available_) {
+        AddPage();
+    }
+    auto page = available_;
+    void* slot;
+    if (page->free) {
+        slot = page->free;
+        ASAN_UNPOISON_MEMORY_REGION(slot, slot_size_);
+        page->free = *static_cast<void**>(slot);
+    } else {
+        slot = page->Slot(page->unused++);
+    }
+    page->used.set(page->IndexOf(slot));
+    if (++page->live == page->capacity) {
+        available_ = page->next_available;
+    }
+    return slot;
+}
+
+// Sweeps the last unswept page, and moves it to the swept ones if it is not empty.
+void Heap::Pool::SweepPage() {
+    Stopwatch stopwatch(&stats_->sweep_time);
+    auto page = pages_[--unswept_];
+    for (size_t i = 0; i < page->unused; ++i) {
+        if (not page->used[i]) {
+            continue;
+        }
+        auto object = reinterpret_cast<Object*>(page->Slot(i));
+        if (object->mark_.load(std::memory_order_relaxed) == epoch_) {
+            continue;
+        }
+        CountFreed(stats_, object, slot_size_);
+        object->~Object();
+        page->used.reset(i);
+        *reinterpret_cast<void**>(object) = page->free;
+        page->free = object;
+        ASAN_POISON_MEMORY_REGION(object, slot_size_);
+        --page->live;
+    }
+    if (page->live == 0) {
+        Unmap(stats_, page, Page::kSize);
+        pages_[unswept_] = pages_.back();
+        pages_.pop_back();
+    } else if (page->live < page->capacity) {
+        page->next_available = available_;
+        available_ = page;
+    }
+}
+
+void Heap::Pool::StartSweep(uint8_t epoch) {
+    epoch_ = epoch;
+    unswept_ = pages_.size();
+    available_ = nullptr;
+}
+
+void Heap::Pool::FinishSweep() {
+    while (unswept_ > 0) {
+        SweepPage();
+    }
+}
+
+void Heap::Pool::Swap(Pool& other) noexcept {
+    std::swap(slot_size_, other.slot_size_);
+    std::swap(stats_, other.stats_);
+    std::swap(pages_, other.pages_);
+    std::swap(unswept_, other.unswept_);
+    std::swap(epoch_, other.epoch_);
+    std::swap(available_, other.available_);
+}
+
+// Promotes every young object it visits and redirects the reference.
+class Heap::Evacuator : public Tracer {
+    Heap* heap_;
+
+public:
+    using Tracer::Visit;
+
+    explicit Evacuator(Heap* heap) : heap_(heap) {}
+
+    void Visit(Value& value) override {
+        auto object = value.GetObject();
+        if (object && object->is_young_) {
+            value = heap_->Promote(object);
+        }
+    }
+};
+
+// Shades every object it visits grey.
+class Heap::Marker : public Tracer {
+    Heap* heap_;
+
+public:
+    using Tracer::Visit;
+
+    explicit Marker(Heap* heap) : heap_(heap) {}
+
+    void Visit(Value& value) override {
+        if (auto object = value.GetObject()) {
+            heap_->Shade(object);
+        }
+    }
+};
+
+// Copies every old object it visits into to-space and redirects the reference.
+// Permanent objects live outside the pools and stay where they are.
+class Heap::Copier : public Tracer {
+    Heap* heap_;
+
+public:
+    using Tracer::Visit;
+
+    explicit Copier(Heap* heap) : heap_(heap) {}
+
+    void Visit(Value& value) override {
+        auto object = value.GetObject();
+        if (not object || object->is_permanent_) {
+            return;
+        }
+        if (not object->forwarding_) {
+            object->forwarding_ = heap_->MoveToOld(object);
+            heap_->promoted_.push_back(object->forwarding_);
+        }
+        value = object->forwarding_;
+    }
+};
+
+// Traces grey objects with a pool of threads. Each worker marks from a private
+// stack and offers its surplus in a shared queue, which idle workers steal
+// from. The thread that starts marking takes part as the first worker.
+class Heap::MarkWorkers {
+    static constexpr size_t kBatch = 64;
+
+    struct Worker {
+        size_t index;
+        std::vector<Object*> local;
+        std::mutex mutex;
+        std::vector<Object*> shared;
+        std::atomic<size_t> available = 0;
+        std::thread thread;
+    };
+
+    // Pushes the objects it marks onto a worker's private stack.
+    class Marker : public Tracer {
+        Worker* worker_;
+        uint8_t epoch_;
+
+    public:
+        using Tracer::Visit;
+
+        Marker(Worker* worker, uint8_t epoch) : worker_(worker), epoch_(epoch) {}
+
+        void Visit(Value& value) override {
+            auto object = value.GetObject();
+            if (object && not object->is_young_ && not object->is_permanent_ &&
+                TryMark(object, epoch_)) {
+                worker_->local.push_back(object);
+            }
+        }
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable finish_;
+    size_t generation_ = 0;
+    size_t running_ = 0;
+    bool stopping_ = false;
+
+    // Workers that may still produce grey objects.
+    std::atomic<size_t> busy_ = 0;
+    // Bumped whenever idle workers may have something to do: work was shared,
+    // the budget ran out or nobody is busy any more. Idle workers sleep on it.
+    std::atomic<uint32_t> wakeups_ = 0;
+    std::atomic<ptrdiff_t> budget_ = 0;
+    std::atomic<bool> exhausted_ = false;
+    std::atomic<size_t> traced_ = 0;
+    bool limited_ = false;
+    uint8_t epoch_ = 0;
+
+    void Loop(Worker* self);
+    void Work(Worker* self);
+    void Share(Worker* self);
+    bool Steal(Worker* self);
+    bool WaitForWork();
+    void WakeIdle();
+
+public:
+    explicit MarkWorkers(size_t threads);
+    ~MarkWorkers();
+    MarkWorkers(const MarkWorkers&) = delete;
+
+    // Traces up to about `budget` objects of `grey`, or all of them and
+    // everything they reach if it is 0, marking with `epoch`. Objects left
+    // untraced are put back. Returns how many were traced.
+    size_t Mark(std::vector<Object*>* grey, size_t budget, uint8_t epoch);
+};
+
+Heap::MarkWorkers::MarkWorkers(size_t threads) {
+    for (size_t i = 0; i < threads; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+        workers_.back()->index = i;
+        workers_.back()->local.reserve(kBufferCapacity);
+        workers_.back()->shared.reserve(kBufferCapacity);
+    }
+    for (size_t i = 1; i < threads; ++i) {
+        auto worker = workers_[i].get();
+        worker->thread = std::thread([this, worker] { Loop(worker); });
+    }
+}
+
+Heap::MarkWorkers::~MarkWorkers() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    start_.notify_all();
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        workers_[i]->thread.join();
+    }
+}
+
+void Heap::MarkWorkers::Loop(Worker* self) {
+    // The profiler samples the interpreter thread, so its timer signal must
+    // not land here.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    size_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            start_.wait(lock, [&] { return stopping_ || generation_ != generation; });
+            if (stopping_) {
+                return;
+            }
+            generation = generation_;
+        }
+        Work(self);
+        std::lock_guard lock(mutex_);
+        if (--running_ == 0) {
+            finish_.notify_one();
+        }
+    }
+}
+
+size_t Heap::MarkWorkers::Mark(std::vector<Object*>* grey, size_t budget, uint8_t epoch) {
+    for (size_t i = 0; i < grey->size(); ++i) {
+        workers_[i % workers_.size()]->shared.push_back((*grey)[i]);
+    }
+    for (auto& worker : workers_) {
+        worker->available = worker->shared.size();
+    }
+    limited_ = budget != 0;
+    budget_ = static_cast<ptrdiff_t>(budget);
+    exhausted_ = false;
+    traced_ = 0;
+    epoch_ = epoch;
+    busy_ = workers_.size();
+    {
+        std::lock_guard lock(mutex_);
+        ++generation_;
+        running_ = workers_.size() - 1;
+    }
+    start_.notify_all();
+    Work(workers_.front().get());
+    {
+        std::unique_lock lock(mutex_);
+        finish_.wait(lock, [&] { return running_ == 0; });
+    }
+
+    grey->clear();
+    for (auto& worker : workers_) {
+        grey->insert(grey->end(), worker->shared.begin(), worker->shared.end());
+        worker->available = 0;
+        ResetBuffer(&worker->shared, kBufferCapacity);
+        ResetBuffer(&worker->local, kBufferCapacity);
+    }
+    return traced_;
+}
+
+void Heap::MarkWorkers::Work(Worker* self) {
+    Marker marker(self, epoch_);
+    size_t claimed = 0;
+    size_t traced = 0;
+    while (not exhausted_.load(std::memory_order_relaxed)) {
+        if (self->local.empty() && not Steal(self)) {
+            if (WaitForWork()) {
+                continue;
+            }
+            break;
+        }
+        if (limited_ && claimed == 0) {
+            if (budget_.fetch_sub(kBatch, std::memory_order_relaxed) <= 0) {
+                exhausted_ = true;
+                WakeIdle();
+                break;
+            }
+            claimed = kBatch;
+        }
+        auto object = self->local.back();
+        self->local.pop_back();
+        object->Trace(marker);
+        ++traced;
+        if (limited_) {
+            --claimed;
+        }
+        Share(self);
+    }
+    traced_ += traced;
+    // What is left when the budget runs out is handed back to the caller.
+    std::lock_guard lock(self->mutex);
+    self->shared.insert(self->shared.end(), self->local.begin(), self->local.end());
+    self->local.clear();
+}
+
+void Heap::MarkWorkers::Share(Worker* self) {
+    if (self->local.size() < 2 * kBatch || self->available.load() >= kBatch) {
+        return;
+    }
+    std::lock_guard lock(self->mutex);
+    self->shared.insert(self->shared.end(), self->local.end() - kBatch, self->local.end());
+    self->local.resize(self->local.size() - kBatch);
+    self->available = self->shared.size();
+    if (busy_.load() < workers_.size()) {
+        WakeIdle();
+    }
+}
+
+// Takes work from the worker's own queue first, then from the others.
+bool Heap::MarkWorkers::Steal(Worker* self) {
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        auto victim = workers_[(self->index + i) % workers_.size()].get();
+        if (victim->available.load() == 0) {
+            continue;
+        }
+        std::lock_guard lock(victim->mutex);
+        auto count = victim == self ? std::min(victim->shared.size(), kBatch)
+                                    : (victim->shared.size() + 1) / 2;
+        self->local.insert(self->local.end(), victim->shared.end() - count,
+                           victim->shared.end());
+        victim->shared.resize(victim->shared.size() - count);
+        victim->available = victim->shared.size();
+        if (count > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Marking is over once no worker is busy and all the queues are empty: only
+// busy workers add to the queues. The wakeup count is read before checking,
+// so a wakeup that comes after the check ends the wait.
+bool Heap::MarkWorkers::WaitForWork() {
+    if (--busy_ == 0) {
+        WakeIdle();
+    }
+    while (true) {
+        auto wakeups = wakeups_.load();
+        if (exhausted_.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        for (auto& worker : workers_) {
+            if (worker->available.load() > 0) {
+                ++busy_;
+                return true;
+            }
+        }
+        if (busy_.load() == 0) {
+            return false;
+        }
+        wakeups_.wait(wakeups);
+    }
+}
+
+void Heap::MarkWorkers::WakeIdle() {
+    ++wakeups_;
+    wakeups_.notify_all();
+}
+
+Heap::Heap() {
+    for (size_t i = 0; i < kSizeClasses; ++i) {
+        pools_[i].Init((i + 1) * kGranularity, &stats_);
+    }
+    finalizable_.reserve(kBufferCapacity);
+    remembered_.reserve(kBufferCapacity);
+    promoted_.reserve(kBufferCapacity);
+    grey_.reserve(kBufferCapacity);
+    mark_threads_ = std::thread::hardware_concurrency();
+}
+
+Heap::~Heap() {
+    for (auto object : finalizable_) {
+        object->~Object();
+    }
+    for (auto& large : large_) {
+        FreeLarge(large);
+    }
+}
+
+void* Heap::AllocateLarge(size_t size) {
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    large_.push_back(LargeObject{memory, size});
+    ++stats_.pages;
+    stats_.page_bytes += size;
+    return memory;
+}
+
+void Heap::FreeLarge(const LargeObject& large) {
+    auto object = static_cast<Object*>(large.memory);
+    CountFreed(&stats_, object, large.size);
+    object->~Object();
+    Unmap(&stats_, large.memory, large.size);
+}
+
+// Unlike the pools, which are swept lazily, large objects are few enough to
+// be swept at once.
+void Heap::SweepLarge() {
+    Stopwatch stopwatch(&stats_.sweep_time);
+    std::erase_if(large_, [&](const LargeObject& large) {
+        auto object = static_cast<Object*>(large.memory);
+        if (object->mark_.load(std::memory_order_relaxed) == epoch_) {
+            return false;
+        }
+        FreeLarge(large);
+        return true;
+    });
+}
+
+Object* Heap::MoveToOld(Object* object) {
+    switch (object->GetType()) {
+        case ObjectType::NUMBER: return MoveToOld<Number>(object);
+        case ObjectType::CELL: return MoveToOld<Cell>(object);
+        case ObjectType::LAMBDA: return MoveToOld<Lambda>(object);
+        case ObjectType::CODE: return MoveToOld<Code>(object);
+        case ObjectType::FRAME: return MoveToOld<Frame>(object);
+        case ObjectType::ENVIRONMENT: return MoveToOld<Environment>(object);
+        case ObjectType::SYMBOL:
+        case ObjectType::BUILTIN:
+            break;
+    }
+    throw std::logic_error("Symbols and builtins are never moved");
+}
+
+Object* Heap::Promote(Object* young) {
+    if (young->forwarding_) {
+        return young->forwarding_;
+    }
+    auto old = MoveToOld(young);
+    young->forwarding_ = old;
+    if (marking_) {
+        Shade(old);
+    }
+    promoted_.push_back(old);
+    return old;
+}
+
+void Heap::CollectYoung() {
+    Evacuator evacuator(this);
+    for (auto roots : root_sets_) {
+        roots->TraceRoots(evacuator);
+    }
+    for (auto object : remembered_) {
+        object->is_remembered_ = false;
+        object->Trace(evacuator);
+    }
+    // Scanning the promoted objects in order promotes everything they reach in turn.
+    for (size_t scan = 0; scan < promoted_.size(); ++scan) {
+        promoted_[scan]->Trace(evacuator);
+    }
+    // Survivors have been moved out, so their leftovers are destroyed as well.
+    for (auto object : finalizable_) {
+        object->~Object();
+    }
+    ResetBuffer(&finalizable_, kBufferCapacity);
+    ResetBuffer(&remembered_, kBufferCapacity);
+    ResetBuffer(&promoted_, kBufferCapacity);
+    nursery_.Reset();
+    for (auto& usage : young_) {
+        stats_.allocated_bytes += usage.bytes;
+        usage = {};
+    }
+    ++stats_.minor_collections;
+}
+
+void Heap::ShadeRoots() {
+    Stopwatch stopwatch(&stats_.mark_time);
+    Marker marker(this);
+    for (auto roots : root_sets_) {
+        roots->TraceRoots(marker);
+    }
+}
+
+void Heap::StartMarking() {
+    // Objects the previous cycle marked must not be mistaken for marked ones
+    // when the epoch comes round again, so the dead ones are swept first.
+    FinishSweep();
+    epoch_ = epoch_ == 1 ? 2 : 1;
+    marked_ = 0;
+    marking_ = true;
+    ShadeRoots();
+}
+
+void Heap::SetMarkThreads(size_t threads) {
+    mark_workers_.reset();
+    mark_threads_ = threads;
+}
+
+// Traces up to `budget` grey objects and returns whether marking is complete.
+bool Heap::MarkSlice(size_t budget) {
+    Stopwatch stopwatch(&stats_.mark_time);
+    if (mark_threads_ > 1 && not grey_.empty() && (budget == 0 || budget >= kMinParallelSlice)) {
+        if (not mark_workers_) {
+            mark_workers_ = std::make_unique<MarkWorkers>(mark_threads_);
+        }
+        marked_ += mark_workers_->Mark(&grey_, budget, epoch_);
+        return grey_.empty();
+    }
+    Marker marker(this);
+    for (size_t i = 0; (budget == 0 || i < budget) && not grey_.empty(); ++i) {
+        auto object = grey_.back();
+        grey_.pop_back();
+        object->Trace(marker);
+        ++marked_;
+    }
+    return grey_.empty();
+}
+
+void Heap::StartSweep() {
+    marking_ = false;
+    ResetBuffer(&grey_, kBufferCapacity);
+    for (auto& pool : pools_) {
+        pool.StartSweep(epoch_);
+    }
+    SweepLarge();
+    old_count_ = marked_;
+    ++stats_.major_collections;
+}
+
+void Heap::FinishSweep() {
+    for (auto& pool : pools_) {
+        pool.FinishSweep();
+    }
+}
+
+void Heap::AddRootSet(RootSet* roots) {
+    if (marking_) {
+        Marker marker(this);
+        roots->TraceRoots(marker);
+    }
+    root_sets_.push_back(roots);
+}
+
+void Heap::RemoveRootSet(RootSet* roots) {
+    root_sets_.erase(std::find(root_sets_.begin(), root_sets_.end(), roots));
+}
+
+void Heap::Collect() {
+    auto start = std::chrono::steady_clock::now();
+    CollectMinorAndMajor();
+    auto pause = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    auto bucket = std::bit_width(static_cast<uint64_t>(pause.count()));
+    ++stats_.pauses[std::min<size_t>(bucket, HeapStats::kPauseBuckets - 1)];
+}
+
+void Heap::CollectMinorAndMajor() {
+    auto old_count = old_count_;
+    CollectYoung();
+    if (not marking_ && old_count_ >= next_major_) {
+        if (compacting_) {
+            CompactOld();
+            return;
+        }
+        StartMarking();
+    }
+    // Promoted objects join the worklist, so the slice grows with them to make
+    // sure that marking keeps up with promotion.
+    auto promoted = old_count_ - old_count;
+    if (not marking_ || not MarkSlice(mark_slice_ == 0 ? 0 : mark_slice_ + promoted)) {
+        return;
+    }
+    // Root sets have no write barrier, so they are scanned again before the
+    // sweep. Anything found there is traced by the following slices.
+    ShadeRoots();
+    if (mark_slice_ == 0) {
+        MarkSlice(0);
+    }
+    if (grey_.empty()) {
+        StartSweep();
+        next_major_ = std::max(kMinMajorThreshold, 2 * old_count_);
+    }
+}
+
+void Heap::Compact() {
+    CollectYoung();
+    CompactOld();
+}
+
+void Heap::CompactOld() {
+    // A major cycle in progress is dropped: copying finds the live objects anew.
+    marking_ = false;
+    ResetBuffer(&grey_, kBufferCapacity);
+
+    std::array<Pool, kSizeClasses> from_space;
+    for (size_t i = 0; i < kSizeClasses; ++i) {
+        from_space[i].Init((i + 1) * kGranularity, &stats_);
+        pools_[i].Swap(from_space[i]);
+    }
+    auto large_from_space = std::move(large_);
+    large_.clear();
+    old_count_ = 0;
+
+    Copier copier(this);
+    for (auto roots : root_sets_) {
+        roots->TraceRoots(copier);
+    }
+    // The copies form the queue of Cheney's algorithm: scanning them in order
+    // copies the objects they reference in breadth-first order.
+    for (size_t scan = 0; scan < promoted_.size(); ++scan) {
+        promoted_[scan]->Trace(copier);
+    }
+    ResetBuffer(&promoted_, kBufferCapacity);
+    next_major_ = std::max(kMinMajorThreshold, 2 * old_count_);
+    ++stats_.major_collections;
+    // Destroying from-space finalizes both the moved-out originals and the
+    // garbage. Large objects are freed the same way.
+    for (auto& large : large_from_space) {
+        FreeLarge(large);
+    }
+}
+
+HeapStats Heap::Stats() const {
+    auto stats = stats_;
+    for (size_t i = 0; i < kObjectTypes; ++i) {
+        stats.usage[i].objects += young_[i].objects;
+        stats.usage[i].bytes += young_[i].bytes;
+        stats.allocated_bytes += young_[i].bytes;
+    }
+    auto& symbols = stats.usage[static_cast<size_t>(ObjectType::SYMBOL)];
+    symbols.objects = Symbol::Count();
+    symbols.bytes = symbols.objects * sizeof(Symbol);
+    std::chrono::duration<double> age = std::chrono::steady_clock::now() - created_;
+    stats.allocation_rate = stats.allocated_bytes / age.count();
+    return stats;
+}
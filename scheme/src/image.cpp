@@ -0,0 +1,565 @@
+#include <scheme/image.h>
+#include <scheme/bytecode.h>
+#include <scheme/code_arena.h>
+#include <scheme/heap.h>
+#include <scheme/mapped_file.h>
+#include <scheme/parser.h>
+
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <unordered_map>
+
+namespace {
+
+// Bumped whenever the layout of the records changes.
+constexpr std::string_view kMagic{"SCMIMG\0\2", 8};
+// The tag that Value leaves unused marks references to objects of the image.
+constexpr uint64_t kReferenceTag = 0b11;
+// The flags recorded for every object.
+constexpr uint8_t kPermanent = 1;
+constexpr uint8_t kConstant = 2;
+
+// Calls a function for every reference an object holds.
+template <class F>
+class FunctionTracer : public Tracer {
+    F f_;
+
+public:
+    using Tracer::Visit;
+
+    explicit FunctionTracer(F f) : f_(f) {}
+
+    void Visit(Value& value) override {
+        f_(value);
+    }
+};
+
+}  // namespace
+
+// Numbers the objects reachable from the scope in breadth-first order, then
+// writes them in that order. Every record starts with the type of the object
+// and whether it is permanent and constant, followed by its own data and its
+// references in the order that Trace visits them.
+class Image::Writer {
+    std::string data_;
+    std::vector<Object*> objects_;
+    std::unordered_map<Object*, uint64_t> indices_;
+
+    template <class T>
+    void Put(T value) {
+        data_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void PutString(const std::string& str) {
+        Put<uint64_t>(str.size());
+        data_ += str;
+    }
+    void PutValue(Value value) {
+        auto object = value.GetObject();
+        Put<uint64_t>(object ? indices_.at(object) << 2 | kReferenceTag : value.GetBits());
+    }
+    void Discover(Value value) {
+        auto object = value.GetObject();
+        if (object && indices_.emplace(object, objects_.size()).second) {
+            objects_.push_back(object);
+        }
+    }
+    void PutObject(Object* object);
+
+public:
+    std::string Write(Environment* scope);
+};
+
+std::string Image::Writer::Write(Environment* scope) {
+    auto definitions = scope->GetDefinitions();
+    for (auto& [name, value] : definitions) {
+        Discover(name);
+        Discover(value);
+    }
+    FunctionTracer discover([this](Value& value) { Discover(value); });
+    for (size_t scan = 0; scan < objects_.size(); ++scan) {
+        if (Is<Code>(objects_[scan])) {
+            Discover(static_cast<Code*>(objects_[scan])->GetName());
+        }
+        objects_[scan]->Trace(discover);
+    }
+
+    data_ = kMagic;
+    Put<uint64_t>(objects_.size());
+    for (auto object : objects_) {
+        PutObject(object);
+    }
+    Put<uint64_t>(definitions.size());
+    for (auto& [name, value] : definitions) {
+        PutValue(name);
+        PutValue(value);
+    }
+    return std::move(data_);
+}
+
+void Image::Writer::PutObject(Object* object) {
+    Put(object->GetType());
+    Put<uint8_t>((object->IsPermanent() ? kPermanent : 0) | (object->IsConstant() ? kConstant : 0));
+    switch (object->GetType()) {
+        case ObjectType::NUMBER:
+            Put(static_cast<Number*>(object)->GetValue());
+            return;
+        case ObjectType::SYMBOL:
+            PutString(static_cast<Symbol*>(object)->GetName());
+            return;
+        case ObjectType::BUILTIN:
+            PutString(static_cast<BuiltIn*>(object)->GetName()->GetName());
+            return;
+        case ObjectType::CODE: {
+            auto code = static_cast<Code*>(object);
+            Put<uint64_t>(code->GetArity());
+            Put<uint64_t>(code->GetFrameSize());
+            PutValue(code->GetName());
+            Put<uint64_t>(code->Size());
+            for (size_t pc = 0; pc < code->Size(); ++pc) {
+                Put(code->At(pc).op);
+                Put(code->At(pc).depth);
+                Put(code->At(pc).arg);
+            }
+            break;
+        }
+        case ObjectType::CELL:
+        case ObjectType::LAMBDA:
+        case ObjectType::FRAME:
+            break;
+        case ObjectType::ENVIRONMENT:
+            throw std::logic_error("Only the global scope can be saved");
+    }
+    std::vector<Value> references;
+    FunctionTracer collect([&](Value& value) { references.push_back(value); });
+    object->Trace(collect);
+    Put<uint64_t>(references.size());
+    for (auto value : references) {
+        PutValue(value);
+    }
+}
+
+// Recreates the objects in a first pass and relocates their references in a
+// second one, since a reference may point to an object further on.
+class Image::Reader {
+    struct Pending {
+        Object* object;
+        // Where the references of the object start in the image.
+        size_t references;
+        // The name of a code, unresolved like the references.
+        uint64_t name = 0;
+    };
+
+    std::string_view data_;
+    size_t pos_ = 0;
+    std::vector<Object*> objects_;
+    std::vector<Pending> pending_;
+    // Each code is checked once for every shape of frames it runs in: the
+    // sizes of its own frame and of the frames around it, innermost first.
+    std::set<std::pair<const Code*, std::vector<size_t>>> checked_;
+
+    [[noreturn]] static void Invalid() {
+        throw RuntimeError("Invalid image");
+    }
+
+    template <class T>
+    T Get() {
+        if (data_.size() - pos_ < sizeof(T)) {
+            Invalid();
+        }
+        T value;
+        std::memcpy(&value, data_.data() + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+    std::string_view GetString() {
+        auto size = Get<uint64_t>();
+        if (data_.size() - pos_ < size) {
+            Invalid();
+        }
+        pos_ += size;
+        return data_.substr(pos_ - size, size);
+    }
+    // Reads a value whose references may still be unresolved.
+    uint64_t GetBits() {
+        auto bits = Get<uint64_t>();
+        if (bits != 0 && (bits & kReferenceTag) == 0) {
+            Invalid();
+        }
+        return bits;
+    }
+    Value Relocate(uint64_t bits) const {
+        if ((bits & kReferenceTag) != kReferenceTag) {
+            auto value = Value::FromBits(bits);
+            if (not value.IsNull() && not value.IsFixnum() && not value.IsBoolean() &&
+                value != Value::Unbound()) {
+                Invalid();
+            }
+            return value;
+        }
+        if ((bits >> 2) >= objects_.size()) {
+            Invalid();
+        }
+        return objects_[bits >> 2];
+    }
+
+    // Objects of the code arena are rebuilt in it without being shared with
+    // equal constants loaded later.
+    template <class T, class... Args>
+    static T* Make(bool permanent, Args... args) {
+        if (permanent) {
+            return CodeArena::Instance().Make<T>(args...);
+        }
+        return Heap::Instance().MakeOld<T>(args...);
+    }
+    Object* GetObject();
+    void RelocateObject(const Pending& pending);
+    static void CheckReference(Object* object, uint64_t index, uint64_t size, Value value);
+    static void CheckCode(const Code* code);
+    void CheckClosure(const Lambda* lambda);
+    void CheckLocals(const Code* code, std::vector<size_t>& frames);
+
+public:
+    explicit Reader(std::string_view data) : data_(data) {}
+
+    void Read(Environment* scope);
+};
+
+void Image::Reader::Read(Environment* scope) {
+    if (not data_.starts_with(kMagic)) {
+        Invalid();
+    }
+    pos_ = kMagic.size();
+    auto count = Get<uint64_t>();
+    for (uint64_t i = 0; i < count; ++i) {
+        objects_.push_back(GetObject());
+    }
+    auto end = pos_;
+    for (auto& pending : pending_) {
+        RelocateObject(pending);
+    }
+    for (auto object : objects_) {
+        if (Is<Lambda>(object)) {
+            CheckClosure(static_cast<Lambda*>(object));
+        }
+    }
+    pos_ = end;
+    auto definitions = Get<uint64_t>();
+    for (uint64_t i = 0; i < definitions; ++i) {
+        auto name = Relocate(GetBits());
+        auto value = Relocate(GetBits());
+        if (not Is<Symbol>(name)) {
+            Invalid();
+        }
+        scope->NewDefinition(As<Symbol>(name), value);
+    }
+    if (pos_ != data_.size()) {
+        Invalid();
+    }
+}
+
+Object* Image::Reader::GetObject() {
+    auto type = Get<ObjectType>();
+    auto flags = Get<uint8_t>();
+    bool permanent = flags & kPermanent;
+    bool constant = flags & kConstant;
+    // Only quoted lists are constant, and those of the code arena always are.
+    if ((flags & ~(kPermanent | kConstant)) != 0 ||
+        (type == ObjectType::CELL ? permanent && not constant : constant)) {
+        Invalid();
+    }
+    Pending pending{};
+    switch (type) {
+        case ObjectType::NUMBER:
+            return Make<Number>(permanent, Get<int64_t>());
+        case ObjectType::SYMBOL:
+            return Symbol::Intern(GetString());
+        case ObjectType::BUILTIN: {
+            auto builtin = BuiltIn::Find(Symbol::Intern(GetString()));
+            if (not builtin) {
+                Invalid();
+            }
+            return builtin;
+        }
+        case ObjectType::CELL:
+            pending.object = Make<Cell>(permanent, Value(), Value());
+            pending.object->is_constant_ = constant;
+            break;
+        case ObjectType::LAMBDA:
+            // Closures and frames are mutable, so they are never permanent.
+            if (permanent) {
+                Invalid();
+            }
+            pending.object = Heap::Instance().MakeOld<Lambda>(static_cast<Code*>(nullptr),
+                                                              static_cast<Frame*>(nullptr));
+            break;
+        case ObjectType::CODE: {
+            auto arity = Get<uint64_t>();
+            auto frame_size = Get<uint64_t>();
+            auto code = Make<Code>(permanent, arity, frame_size);
+            pending.name = GetBits();
+            auto size = Get<uint64_t>();
+            for (uint64_t pc = 0; pc < size; ++pc) {
+                auto op = Get<OpCode>();
+                auto depth = Get<uint16_t>();
+                code->Emit(op, Get<uint32_t>(), depth);
+            }
+            pending.object = code;
+            break;
+        }
+        case ObjectType::FRAME: {
+            // The references of a frame are its slots followed by its parent.
+            auto size = Get<uint64_t>();
+            if (permanent || size == 0 || (data_.size() - pos_) / sizeof(uint64_t) < size) {
+                Invalid();
+            }
+            pos_ -= sizeof(uint64_t);
+            pending.object =
+                Heap::Instance().MakeOld<Frame>(size - 1, static_cast<Frame*>(nullptr));
+            break;
+        }
+        default:
+            Invalid();
+    }
+    // Codes are created without constants, which relocation adds.
+    pending.references = pos_;
+    auto size = Get<uint64_t>();
+    if ((data_.size() - pos_) / sizeof(uint64_t) < size) {
+        Invalid();
+    }
+    pos_ += size * sizeof(uint64_t);
+    pending_.push_back(pending);
+    return pending.object;
+}
+
+void Image::Reader::RelocateObject(const Pending& pending) {
+    auto& heap = Heap::Instance();
+    auto object = pending.object;
+    pos_ = pending.references;
+    auto size = Get<uint64_t>();
+    if (Is<Code>(object)) {
+        auto code = static_cast<Code*>(object);
+        auto name = Relocate(pending.name);
+        if (name && not Is<Symbol>(name)) {
+            Invalid();
+        }
+        code->SetName(static_cast<Symbol*>(name.GetObject()));
+        for (uint64_t i = 0; i < size; ++i) {
+            code->AddConstant(nullptr);
+        }
+    }
+    uint64_t visited = 0;
+    FunctionTracer relocate([&](Value& value) {
+        if (visited >= size) {
+            Invalid();
+        }
+        auto relocated = Relocate(GetBits());
+        CheckReference(object, visited++, size, relocated);
+        heap.WriteBarrier(object, relocated);
+        value = relocated;
+    });
+    object->Trace(relocate);
+    if (visited != size) {
+        Invalid();
+    }
+    if (Is<Code>(object)) {
+        CheckCode(static_cast<Code*>(object));
+    }
+}
+
+// Closures and frames keep typed references, which relocation would cast to
+// whatever the image names, so their types are checked before they are stored.
+// The code of a closure is required, the parent frames are optional.
+void Image::Reader::CheckReference(Object* object, uint64_t index, uint64_t size,
+                                   Value value) {
+    auto expected = ObjectType::FRAME;
+    if (Is<Lambda>(object) && index == 0) {
+        expected = ObjectType::CODE;
+    } else if (not Is<Lambda>(object) && not (Is<Frame>(object) && index == size - 1)) {
+        return;
+    }
+    auto referenced = value.GetObject();
+    if (referenced ? referenced->GetType() != expected
+                   : not value.IsNull() || expected == ObjectType::CODE) {
+        Invalid();
+    }
+}
+
+// Every jump stays within the code, which the compiler always ends with a
+// return, every constant index is in range and the arguments fit the frame.
+// Every path to an instruction leaves the value stack equally deep, and deep
+// enough for the operands the instruction pops.
+void Image::Reader::CheckCode(const Code* code) {
+    if (code->GetArity() > code->GetFrameSize() || code->Size() == 0 ||
+        code->At(code->Size() - 1).op != OpCode::RETURN) {
+        Invalid();
+    }
+    for (size_t pc = 0; pc < code->Size(); ++pc) {
+        auto& instruction = code->At(pc);
+        switch (instruction.op) {
+            case OpCode::CONSTANT:
+            case OpCode::LOAD_GLOBAL:
+            case OpCode::DEFINE_GLOBAL:
+            case OpCode::SET_GLOBAL:
+            case OpCode::MAKE_LAMBDA:
+                if (instruction.arg >= code->ConstantCount()) {
+                    Invalid();
+                }
+                break;
+            case OpCode::JUMP:
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::JUMP_IF_FALSE_KEEP:
+            case OpCode::JUMP_IF_TRUE_KEEP:
+                if (instruction.arg >= code->Size()) {
+                    Invalid();
+                }
+                break;
+            case OpCode::LOAD_LOCAL:
+            case OpCode::DEFINE_LOCAL:
+            case OpCode::SET_LOCAL:
+            case OpCode::POP:
+            case OpCode::CALL:
+            case OpCode::TAIL_CALL:
+            case OpCode::RETURN:
+                break;
+            default:
+                Invalid();
+        }
+    }
+
+    std::vector<int64_t> depths(code->Size(), -1);
+    std::vector<size_t> pending{0};
+    depths[0] = 0;
+    auto flow = [&](size_t pc, int64_t depth) {
+        if (pc >= code->Size()) {
+            Invalid();
+        }
+        if (depths[pc] < 0) {
+            depths[pc] = depth;
+            pending.push_back(pc);
+        } else if (depths[pc] != depth) {
+            Invalid();
+        }
+    };
+    while (not pending.empty()) {
+        auto pc = pending.back();
+        pending.pop_back();
+        auto& instruction = code->At(pc);
+        auto depth = depths[pc];
+        auto pop = [&](int64_t count) {
+            if (depth < count) {
+                Invalid();
+            }
+            depth -= count;
+        };
+        switch (instruction.op) {
+            case OpCode::CONSTANT:
+            case OpCode::LOAD_LOCAL:
+            case OpCode::LOAD_GLOBAL:
+            case OpCode::MAKE_LAMBDA:
+                flow(pc + 1, depth + 1);
+                break;
+            case OpCode::DEFINE_LOCAL:
+            case OpCode::DEFINE_GLOBAL:
+            case OpCode::SET_LOCAL:
+            case OpCode::SET_GLOBAL:
+                pop(1);
+                flow(pc + 1, depth + 1);
+                break;
+            case OpCode::POP:
+                pop(1);
+                flow(pc + 1, depth);
+                break;
+            case OpCode::JUMP:
+                flow(instruction.arg, depth);
+                break;
+            case OpCode::JUMP_IF_FALSE:
+                pop(1);
+                flow(instruction.arg, depth);
+                flow(pc + 1, depth);
+                break;
+            case OpCode::JUMP_IF_FALSE_KEEP:
+            case OpCode::JUMP_IF_TRUE_KEEP:
+                pop(1);
+                flow(instruction.arg, depth + 1);
+                flow(pc + 1, depth);
+                break;
+            // A tail call to a builtin goes on with the next instruction.
+            case OpCode::CALL:
+            case OpCode::TAIL_CALL:
+                pop(int64_t{instruction.arg} + 1);
+                flow(pc + 1, depth + 1);
+                break;
+            case OpCode::RETURN:
+                pop(1);
+                break;
+        }
+    }
+}
+
+// A closure runs its code in a new frame whose parent is the frame it closed
+// over. Lambdas are never nested deeper than the reader nests lists, which
+// also bounds a chain of frames that loops.
+void Image::Reader::CheckClosure(const Lambda* lambda) {
+    std::vector<size_t> frames{lambda->GetCode()->GetFrameSize()};
+    for (auto frame = lambda->GetParentFrame(); frame; frame = frame->GetParent()) {
+        if (frames.size() > kDefaultMaxDepth) {
+            Invalid();
+        }
+        frames.push_back(frame->GetSize());
+    }
+    CheckLocals(lambda->GetCode(), frames);
+}
+
+// Local variables are addressed within the frames, and the lambdas the code
+// makes run in a frame of their own inside its frame.
+void Image::Reader::CheckLocals(const Code* code, std::vector<size_t>& frames) {
+    if (frames.size() > kDefaultMaxDepth + 1) {
+        Invalid();
+    }
+    if (not checked_.emplace(code, frames).second) {
+        return;
+    }
+    for (size_t pc = 0; pc < code->Size(); ++pc) {
+        auto& instruction = code->At(pc);
+        switch (instruction.op) {
+            case OpCode::DEFINE_LOCAL:
+                if (instruction.depth != 0) {
+                    Invalid();
+                }
+                [[fallthrough]];
+            case OpCode::LOAD_LOCAL:
+            case OpCode::SET_LOCAL:
+                if (instruction.depth >= frames.size() ||
+                    instruction.arg >= frames[instruction.depth]) {
+                    Invalid();
+                }
+                break;
+            case OpCode::MAKE_LAMBDA: {
+                auto body = code->GetConstant(instruction.arg);
+                if (not Is<Code>(body)) {
+                    Invalid();
+                }
+                frames.insert(frames.begin(), As<Code>(body)->GetFrameSize());
+                CheckLocals(As<Code>(body), frames);
+                frames.erase(frames.begin());
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+void Image::Save(Environment* scope, const std::string& path) {
+    auto data = Writer().Write(scope);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (not out.write(data.data(), data.size())) {
+        throw RuntimeError("Cannot write " + path);
+    }
+}
+
+void Image::Load(const std::string& path, Environment* scope) {
+    MappedFile file(path);
+    Reader(file.View()).Read(scope);
+}
@@ -0,0 +1,37 @@
+#include <scheme/mapped_file.h>
+#include <scheme/error.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw RuntimeError("Cannot open " + path);
+    }
+    struct stat info {};
+    if (fstat(fd, &info) != 0 || not S_ISREG(info.st_mode)) {
+        close(fd);
+        throw RuntimeError("Cannot read " + path);
+    }
+    size_ = info.st_size;
+    // An empty file cannot be mapped, and has nothing to map anyway.
+    if (size_ > 0) {
+        data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data_ == MAP_FAILED) {
+        throw RuntimeError("Cannot map " + path);
+    }
+    if (data_) {
+        madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data_) {
+        munmap(data_, size_);
+    }
+}
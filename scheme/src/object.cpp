@@ -5,517 +5,535 @@
 #include <scheme/heap.h>
 #include <scheme/error.h>
 #include <scheme/scheme.h>
+#include <scheme/bytecode.h>
 
+#include <functional>
 #include <numeric>
+#include <unordered_map>
+#include <utility>
 
-Object* Eval(Object* ast, Environment* scope) {
-    if (ast == nullptr) {
-        throw RuntimeError("() cannot be evaluated");
+std::string ToString(Value ast) {
+    if (ast.IsNull()) {
+        return "()";
+    }
+    if (ast.IsFixnum()) {
+        return std::to_string(ast.GetFixnum());
+    }
+    if (ast == Value::True()) {
+        return "#t";
     }
-    return ast->Eval(scope);
+    if (ast == Value::False()) {
+        return "#f";
+    }
+    if (ast == Value::Unbound()) {
+        return "#<unbound>";
+    }
+    return ast.GetObject()->ToString();
 }
 
-std::string ToString(Object* ast) {
-    if (ast == nullptr) {
-        return "()";
+Value MakeInteger(int64_t value) {
+    if (Value::FitsFixnum(value)) {
+        return Value::Fixnum(value);
     }
-    return ast->ToString();
+    return Heap::Instance().Make<Number>(value);
 }
-void Object::Mark() {
-    if (not is_reachable_) {
-        is_reachable_ = true;
-        MarkDependencies();
+
+int64_t AsInteger(Value value) {
+    if (value.IsFixnum()) {
+        return value.GetFixnum();
+    }
+    if (not Is<Number>(value)) {
+        throw RuntimeError("Expected type does not match.");
     }
+    return static_cast<Number*>(value.GetObject())->GetValue();
+}
+
+void Object::Trace(Tracer&) {}
+
+std::string_view TypeName(ObjectType type) {
+    static constexpr std::string_view kNames[kObjectTypes] = {
+        "number", "symbol", "cell", "builtin", "lambda", "code", "frame", "environment"};
+    return kNames[static_cast<size_t>(type)];
 }
-[[maybe_unused]] void Object::MarkDependencies() {}
 
-Number::Number(int64_t value) : value_(value) {}
+Number::Number(int64_t value) : Object(kType), value_(value) {}
 int64_t Number::GetValue() const { return value_; }
-Object* Number::Eval(Environment*) { return this; }
 std::string Number::ToString() const { return std::to_string(value_); }
 
-Object* Symbol::True()  { return Heap::Instance().Make<Symbol>("#t"); }
-Object* Symbol::False() { return Heap::Instance().Make<Symbol>("#f"); }
+BuiltIn::BuiltIn(Symbol* name, Function function, size_t min_arity, size_t max_arity)
+    : Callable(kType),
+      name_(name),
+      function_(function),
+      min_arity_(min_arity),
+      max_arity_(max_arity) {}
+
+class SymbolTable {
+    std::unordered_map<std::string_view, Symbol*> index_;
+    std::vector<std::unique_ptr<Symbol>> symbols_;
+
+public:
+    static SymbolTable& Instance() {
+        static SymbolTable table;
+        return table;
+    }
+
+    Symbol* Intern(std::string_view name) {
+        if (auto it = index_.find(name); it != index_.end()) {
+            return it->second;
+        }
+        auto symbol =
+            symbols_.emplace_back(std::make_unique<Symbol>(std::string(name), symbols_.size())).get();
+        index_.emplace(symbol->GetName(), symbol);
+        return symbol;
+    }
+
+    Symbol* FromId(size_t id) {
+        return symbols_[id].get();
+    }
+
+    size_t Size() const {
+        return symbols_.size();
+    }
+};
 
-Symbol::Symbol(std::string name) : name_(std::move(name)) {}
+Symbol* Symbol::Intern(std::string_view name) { return SymbolTable::Instance().Intern(name); }
+Symbol* Symbol::FromId(size_t id) { return SymbolTable::Instance().FromId(id); }
+size_t Symbol::Count() { return SymbolTable::Instance().Size(); }
+
+Symbol::Symbol(std::string name, size_t id) : Object(kType, true), name_(std::move(name)), id_(id) {}
 const std::string& Symbol::GetName() const { return name_; }
-Object* Symbol::Eval(Environment* scope) { return scope->GetDefinition(name_); }
+size_t Symbol::GetId() const { return id_; }
 std::string Symbol::ToString() const { return name_; }
 
-Cell::Cell(Object* first, Object* second) : first_(first), second_(second) {}
-Object* Cell::GetFirst() const { return first_; }
-Object* Cell::GetSecond() const { return second_; }
-Object* Cell::Eval(Environment* scope) {
-    return As<Callable>(::Eval(first_, scope))->Call(second_, scope);
-}
+Cell::Cell(Value first, Value second) : Object(kType), first_(first), second_(second) {}
+Value Cell::GetFirst() const { return first_; }
+Value Cell::GetSecond() const { return second_; }
 std::string Cell::ToString() const {
-    return ArgList((Object*)this).ToString();
+    return ArgList(const_cast<Cell*>(this)).ToString();
 }
-void Cell::SetFirst(Object* o) { first_ = o; }
-void Cell::SetSecond(Object* o) { second_ = o; }
-void Cell::MarkDependencies() {
-    Heap::Instance().Mark(first_);
-    Heap::Instance().Mark(second_);
+void Cell::SetFirst(Value v) {
+    Heap::Instance().WriteBarrier(this, v);
+    first_ = v;
 }
-
-BuiltInSyntax::BuiltInSyntax(std::function<Object*(Object*, Environment*)> value) : value_(value){}
-
-Object* BuiltInSyntax::Call(Object* o, Environment* env) {
-    return value_(o, env);
-}
-
-Object* BuiltInSyntax::Eval(Environment*) {
-    throw RuntimeError("Trying to evaluate a syntax keyword");
+void Cell::SetSecond(Value v) {
+    Heap::Instance().WriteBarrier(this, v);
+    second_ = v;
 }
-std::string BuiltInSyntax::ToString() const { return "BuiltInSyntax"; }
-
-Object* BuiltInSyntaxTailRecursive::Call(Object* o, Environment* s) {
-    return ::Eval(CallUntilTail(o, s), s);
+void Cell::Trace(Tracer& tracer) {
+    tracer.Visit(first_);
+    tracer.Visit(second_);
 }
 
-Object* BuiltInSyntaxTailRecursive::CallUntilTail(Object* o, Environment* s) {
-    return BuiltInSyntax::Call(o, s);
+// Walks lists along their cells, so only their nesting takes C++ stack, which
+// the reader limits. Cells marked before, like those of the code arena, are
+// skipped with everything they hold.
+void MakeConstant(Value datum) {
+    for (; Is<Cell>(datum) && not datum.GetObject()->is_constant_;
+         datum = As<Cell>(datum)->GetSecond()) {
+        datum.GetObject()->is_constant_ = true;
+        MakeConstant(As<Cell>(datum)->GetFirst());
+    }
 }
 
-Lambda::Lambda(std::vector<Symbol*> formals, Object* ast, Environment* parent_scope)
-    : ast_(ast), formals_(formals), parent_scope_(parent_scope) {}
-Object* Lambda::Eval(Environment*) {
-    throw SyntaxError("Trying to evaluate a procedure");
-}
+Lambda::Lambda(Code* code, Frame* parent_frame)
+    : Callable(kType), code_(code), parent_frame_(parent_frame) {}
+Code* Lambda::GetCode() const { return code_; }
+Frame* Lambda::GetParentFrame() const { return parent_frame_; }
 std::string Lambda::ToString() const {
     return "Lambda";
 }
-Object* Lambda::Call(Object* ast, Environment* scope) {
-    while (true) {
-        auto args = ArgList(ast).ExpectSize(formals_.size());
-        auto local_scope = Heap::Instance().Make<Environment>();
-        local_scope->SetParent(parent_scope_);
-        for (size_t i = 0; i < args.Size(); ++i) {
-            local_scope->NewDefinition(formals_[i]->GetName(), args.Eval(i, scope));
-        }
-        if (Is<Cell>(ast_)) {
-            auto c = As<Cell>(ast_);
-            auto cf = scope->GetDefinition(As<Symbol>(c->GetFirst())->GetName());
-            if (cf == this) {
-                ast = c->GetSecond();
-                continue;
-            }
-            if (Is<BuiltInSyntaxTailRecursive>(cf)) {
-                auto b = As<BuiltInSyntaxTailRecursive>(cf);
-                auto tail = b->CallUntilTail(c->GetSecond(), local_scope);
-                if (Is<Cell>(tail)) {
-                    auto t = As<Cell>(tail);
-                    if (local_scope->GetDefinition(As<Symbol>(t->GetFirst())->GetName()) == this) {
-                        ast = t->GetSecond();
-                        continue;
-                    }
-                }
-                return ::Eval(tail, local_scope);
-            }
-        }
-        return ::Eval(ast_, local_scope);
+void Lambda::Trace(Tracer& tracer) {
+    tracer.Visit(code_);
+    tracer.Visit(parent_frame_);
+}
+
+Frame::Frame(size_t size, Frame* parent)
+    : Object(kType), slots_(size, Value::Unbound()), parent_(parent) {}
+Frame* Frame::GetParent() const { return parent_; }
+size_t Frame::GetSize() const { return slots_.size(); }
+Value Frame::Get(size_t depth, size_t index) {
+    auto frame = this;
+    while (depth--) {
+        frame = frame->parent_;
     }
+    return frame->slots_[index];
 }
-void Lambda::MarkDependencies() {
-    Heap::Instance().Mark(ast_);
-    Heap::Instance().Mark(parent_scope_);
-    for (auto f : formals_) {
-        Heap::Instance().Mark(f);
+void Frame::Set(size_t depth, size_t index, Value v) {
+    auto frame = this;
+    while (depth--) {
+        frame = frame->parent_;
     }
+    Heap::Instance().WriteBarrier(frame, v);
+    frame->slots_[index] = v;
 }
-
-Object* BoolSymbol(bool b) {
-    return (b ? Symbol::True() : Symbol::False());
+void Frame::Trace(Tracer& tracer) {
+    for (auto& v : slots_) {
+        tracer.Visit(v);
+    }
+    tracer.Visit(parent_);
+}
+std::string Frame::ToString() const {
+    return "Frame";
 }
 
-bool EvalToTrue(Object* obj) {
-    if (Is<Symbol>(obj)) {
-        const auto& val = As<Symbol>(obj)->GetName();
-        if (val == "#f") {
-            return false;
-        }
+static Value MakeList(const std::vector<Value>& items) {
+    Value list = nullptr;
+    for (auto it = items.rbegin(); it != items.rend(); ++it) {
+        list = Heap::Instance().Make<Cell>(*it, list);
     }
-    return true;
+    return list;
 }
 
-Environment* Environment::R5RS() {
-    Heap& h = Heap::Instance();
-    Environment* scope = h.Make<Environment>();
-    auto& names = scope->names_;
-    names["#t"] = Symbol::True();
-    names["#f"] = Symbol::False();
-    names["null?"] = h.Make<BuiltInProc<Object>>([](auto& args) {
-        RequireSize<1>(args);
-        return BoolSymbol(args[0] == nullptr);
-    });
-
-    names["pair?"] = h.Make<BuiltInProc<Object>>([](auto& args) {
-        RequireSize<1>(args);
-        return BoolSymbol(Is<Cell>(args[0]));
-    });
-
-    names["list?"] = h.Make<BuiltInProc<Object>>([](auto& args) {
-        RequireSize<1>(args);
-        if (args[0] != nullptr && not Is<Cell>(args[0])) {
-            return Symbol::False();
-        }
-        if (ArgList(args[0]).IsProper()) {
-            return Symbol::True();
-        }
-        return Symbol::False();
-    });
-
-    names["number?"] = h.Make<BuiltInProc<Object>>([](auto& args) {
-        RequireSize<1>(args);
-        return BoolSymbol(Is<Number>(args[0]));
-    });
-
-    names["symbol?"] = h.Make<BuiltInProc<Object>>([](auto& args) {
-        RequireSize<1>(args);
-        return BoolSymbol(Is<Symbol>(args[0]));
-    });
-
-    names["boolean?"] = h.Make<BuiltInProc<Object>>([](auto& args) {
-        RequireSize<1>(args);
-        if (not Is<Symbol>(args[0])) {
-            return Symbol::False();
-        }
-        return BoolSymbol(As<Symbol>(args[0])->GetName() == "#t" ||
-                          As<Symbol>(args[0])->GetName() == "#f");
+// Heap::Stats as an association list, with usage given as (type objects bytes)
+// entries and durations in microseconds.
+static Value StatsToList(const HeapStats& stats) {
+    auto entry = [](const char* name, Value value) {
+        return Heap::Instance().Make<Cell>(Symbol::Intern(name), value);
+    };
+    auto microseconds = [](std::chrono::nanoseconds time) {
+        return MakeInteger(std::chrono::duration_cast<std::chrono::microseconds>(time).count());
+    };
+    std::vector<Value> usage;
+    for (size_t i = 0; i < kObjectTypes; ++i) {
+        auto name = Symbol::Intern(TypeName(static_cast<ObjectType>(i)));
+        usage.push_back(MakeList({name, MakeInteger(stats.usage[i].objects),
+                                  MakeInteger(stats.usage[i].bytes)}));
+    }
+    std::vector<Value> pauses;
+    for (auto count : stats.pauses) {
+        pauses.push_back(MakeInteger(count));
+    }
+    return MakeList({
+        entry("minor-collections", MakeInteger(stats.minor_collections)),
+        entry("major-collections", MakeInteger(stats.major_collections)),
+        entry("allocated-bytes", MakeInteger(stats.allocated_bytes)),
+        entry("allocation-rate", MakeInteger(stats.allocation_rate)),
+        entry("mark-time", microseconds(stats.mark_time)),
+        entry("sweep-time", microseconds(stats.sweep_time)),
+        entry("pauses", MakeList(pauses)),
+        entry("usage", MakeList(usage)),
+        entry("pages", MakeInteger(stats.pages)),
+        entry("page-bytes", MakeInteger(stats.page_bytes)),
     });
+}
 
-    names["not"] = h.Make<BuiltInProc<Object>>([](auto& args) {
-        RequireSize<1>(args);
-        return BoolSymbol(not EvalToTrue(args[0]));
-    });
+namespace {
+
+// Converts an argument to the type that a primitive declares for it.
+template <class T>
+T Argument(Value value) {
+    if constexpr (std::is_same_v<T, Value>) {
+        return value;
+    } else if constexpr (std::is_same_v<T, int64_t>) {
+        return AsInteger(value);
+    } else {
+        return As<std::remove_pointer_t<T>>(value);
+    }
+}
 
-    names["and"] = h.Make<BuiltInSyntaxTailRecursive>([](auto ast, auto scope){
-        auto args = ArgList(ast);
-        if (args.Size() == 0) {
-            return Symbol::True();
-        }
-        for (size_t i = 0; i < args.Size()-1; ++i) {
-            auto eval = args.Eval(i, scope);
-            if (!EvalToTrue(eval)) {
-                return eval;
-            }
-        }
-        return args.At(args.Size()-1);
-    });
+// Calls a primitive of fixed arity with its arguments converted to the
+// declared types. The arity comes from the signature and is checked before.
+template <auto F>
+struct Fixed;
 
-    names["or"] = h.Make<BuiltInSyntaxTailRecursive>([](auto ast, auto scope){
-        auto args = ArgList(ast);
-        if (args.Size() == 0) {
-            return Symbol::False();
-        }
-        for (size_t i = 0; i < args.Size()-1; ++i) {
-            auto eval = args.Eval(i, scope);
-            if (EvalToTrue(eval)) {
-                return eval;
-            }
-        }
-        return args.At(args.Size()-1);
-    });
+template <class... Args, Value (*F)(Args...)>
+struct Fixed<F> {
+    static constexpr size_t kArity = sizeof...(Args);
 
-    names["+"] = h.Make<BuiltInProc<Number>>([](auto& args) {
-        int64_t value = 0;
-        for (auto o : args) {
-            value += o->GetValue();
-        }
-        return Heap::Instance().Make<Number>(value);
-    });
-
-    names["*"] = h.Make<BuiltInProc<Number>>([](auto& args) {
-        int64_t value = 1;
-        for (auto o : args) {
-            value *= o->GetValue();
-        }
-        return Heap::Instance().Make<Number>(value);
-    });
+    static Value Call(std::span<const Value> args) {
+        return [args]<size_t... I>(std::index_sequence<I...>) {
+            return F(Argument<Args>(args[I])...);
+        }(std::index_sequence_for<Args...>{});
+    }
+};
+
+struct Primitive {
+    std::string_view name;
+    BuiltIn::Function function;
+    size_t min_arity;
+    size_t max_arity;
+};
+
+template <auto F>
+constexpr Primitive MakeFixed(std::string_view name) {
+    return {name, Fixed<F>::Call, Fixed<F>::kArity, Fixed<F>::kArity};
+}
 
-    names["-"] = h.Make<BuiltInProc<Number>>([](auto& args){
-        RequireSizeAtLeast<1>(args);
-        int64_t value = args[0]->GetValue();
-        if (args.size() == 1) {
-            return Heap::Instance().Make<Number>(-value);
-        }
-        for (size_t i = 1; i < args.size(); ++i) {
-            value -= args[i]->GetValue();
-        }
-        return Heap::Instance().Make<Number>(value);
-    });
+constexpr Primitive MakeVariadic(std::string_view name, BuiltIn::Function function,
+                                 size_t min_arity = 0) {
+    return {name, function, min_arity, BuiltIn::kVariadic};
+}
 
-    names["/"] = h.Make<BuiltInProc<Number>>([](auto& args){
-        RequireSizeAtLeast<1>(args);
-        int64_t value = args[0]->GetValue();
-        if (args.size() == 1) {
-            return Heap::Instance().Make<Number>(1 / value);
-        }
-        for (size_t i = 1; i < args.size(); ++i) {
-            value /= args[i]->GetValue();
-        }
-        return Heap::Instance().Make<Number>(value);
-    });
+// Quoted data are constant however the code that quotes them was compiled:
+// constants of loaded code are shared and live in the code arena, where nothing
+// may be made to reference the collected heap.
+void RequireMutable(Cell* cell) {
+    if (cell->IsConstant()) {
+        throw RuntimeError("Cannot modify a constant");
+    }
+}
 
-    names["quote"] = h.Make<BuiltInSyntax>([](auto ast, [[maybe_unused]] auto scope){
-        auto args = ArgList(ast).ExpectSize(1);
-        return args.At(0);
-    });
+Value IsNull(Value v) { return Value::Boolean(v == nullptr); }
+Value IsPair(Value v) { return Value::Boolean(Is<Cell>(v)); }
+Value IsNumber(Value v) { return Value::Boolean(Is<Number>(v)); }
+Value IsSymbol(Value v) { return Value::Boolean(Is<Symbol>(v)); }
+Value IsBoolean(Value v) { return Value::Boolean(v.IsBoolean()); }
+Value Not(Value v) { return Value::Boolean(not v.IsTrue()); }
 
-    names["abs"] = h.Make<BuiltInProc<Number>>([](auto& args){
-        RequireSize<1>(args);
-        return Heap::Instance().Make<Number>(std::abs(args[0]->GetValue()));
-    });
+Value IsList(Value v) {
+    if (v != nullptr && not Is<Cell>(v)) {
+        return Value::False();
+    }
+    return Value::Boolean(ArgList(v).IsProper());
+}
 
-    names["="] = h.Make<BuiltInProc<Number>>([](auto& args){
-        for (size_t i = 0; i+1 < args.size(); ++i) {
-            if (args[i]->GetValue() != args[i + 1]->GetValue()) {
-                return Symbol::False();
-            }
-        }
-        return Symbol::True();
-    });
+Value Add(std::span<const Value> args) {
+    int64_t value = 0;
+    for (auto arg : args) {
+        value += AsInteger(arg);
+    }
+    return MakeInteger(value);
+}
 
-    names["<"] = h.Make<BuiltInProc<Number>>([](auto& args){
-        for (size_t i = 0; i+1 < args.size(); ++i) {
-            if (args[i]->GetValue() >= args[i + 1]->GetValue()) {
-                return Symbol::False();
-            }
-        }
-        return Symbol::True();
-    });
+Value Multiply(std::span<const Value> args) {
+    int64_t value = 1;
+    for (auto arg : args) {
+        value *= AsInteger(arg);
+    }
+    return MakeInteger(value);
+}
 
-    names[">"] = h.Make<BuiltInProc<Number>>([](auto& args){
-        for (size_t i = 0; i+1 < args.size(); ++i) {
-            if (args[i]->GetValue() <= args[i + 1]->GetValue()) {
-                return Symbol::False();
-            }
-        }
-        return Symbol::True();
-    });
+Value Subtract(std::span<const Value> args) {
+    int64_t value = AsInteger(args[0]);
+    if (args.size() == 1) {
+        return MakeInteger(-value);
+    }
+    for (size_t i = 1; i < args.size(); ++i) {
+        value -= AsInteger(args[i]);
+    }
+    return MakeInteger(value);
+}
 
-    names["<="] = h.Make<BuiltInProc<Number>>([](auto& args){
-        for (size_t i = 0; i+1 < args.size(); ++i) {
-            if (args[i]->GetValue() > args[i + 1]->GetValue()) {
-                return Symbol::False();
-            }
-        }
-        return Symbol::True();
-    });
+Value Divide(std::span<const Value> args) {
+    int64_t value = AsInteger(args[0]);
+    if (args.size() == 1) {
+        return MakeInteger(1 / value);
+    }
+    for (size_t i = 1; i < args.size(); ++i) {
+        value /= AsInteger(args[i]);
+    }
+    return MakeInteger(value);
+}
 
-    names[">="] = h.Make<BuiltInProc<Number>>([](auto& args){
-        for (size_t i = 0; i+1 < args.size(); ++i) {
-            if (args[i]->GetValue() < args[i + 1]->GetValue()) {
-                return Symbol::False();
-            }
-        }
-        return Symbol::True();
-    });
+Value Abs(int64_t value) { return MakeInteger(std::abs(value)); }
 
-    names["max"] = h.Make<BuiltInProc<Number>>([](auto& args){
-        RequireSizeAtLeast<1>(args);
-        int64_t value = args[0]->GetValue();
-        for (size_t i = 1; i < args.size(); ++i) {
-            value = std::max(value, args[i]->GetValue());
-        }
-        return Heap::Instance().Make<Number>(value);
-    });
+// Whether every argument is in the relation to the next one. All of them are
+// checked to be numbers, even when an early pair already fails.
+template <class Relation>
+Value Compare(std::span<const Value> args) {
+    bool holds = true;
+    for (size_t i = 0; i + 1 < args.size(); ++i) {
+        holds = Relation()(AsInteger(args[i]), AsInteger(args[i + 1])) && holds;
+    }
+    return Value::Boolean(holds);
+}
 
-    names["min"] = h.Make<BuiltInProc<Number>>([](auto& args){
-        RequireSizeAtLeast<1>(args);
-        int64_t value = args[0]->GetValue();
-        for (size_t i = 1; i < args.size(); ++i) {
-            value = std::min(value, args[i]->GetValue());
+// The argument that comes first in the order.
+template <class Order>
+Value Extremum(std::span<const Value> args) {
+    int64_t value = AsInteger(args[0]);
+    for (size_t i = 1; i < args.size(); ++i) {
+        auto other = AsInteger(args[i]);
+        if (Order()(other, value)) {
+            value = other;
         }
-        return Heap::Instance().Make<Number>(value);
-    });
-
-    names["cons"] = h.Make<BuiltInProc<Object>>([](auto& args) {
-        RequireSize<2>(args);
-        return Heap::Instance().Make<Cell>(args[0], args[1]);
-    });
-
-    names["car"] = h.Make<BuiltInProc<Cell>>([](auto& args) {
-        RequireSize<1>(args);
-        return args[0]->GetFirst();
-    });
+    }
+    return MakeInteger(value);
+}
 
-    names["cdr"] = h.Make<BuiltInProc<Cell>>([](auto& args) {
-        RequireSize<1>(args);
-        return args[0]->GetSecond();
-    });
+Value Cons(Value first, Value second) { return Heap::Instance().Make<Cell>(first, second); }
+Value Car(Cell* cell) { return cell->GetFirst(); }
+Value Cdr(Cell* cell) { return cell->GetSecond(); }
 
-    names["list"] = h.Make<BuiltInProc<Object>>([](auto& args) {
-        Cell* list = nullptr;
-        for (int i = args.size()-1; i >= 0; --i) {
-            list = Heap::Instance().Make<Cell>(args[i], list);
-        }
-        return list;
-    });
+Value List(std::span<const Value> args) {
+    Value list = nullptr;
+    for (size_t i = args.size(); i-- > 0;) {
+        list = Heap::Instance().Make<Cell>(args[i], list);
+    }
+    return list;
+}
 
-    names["list-ref"] = h.Make<BuiltInSyntax>([](auto ast, auto scope){
-        auto args = ArgList(ast).ExpectSize(2);
-        auto list = ArgList(args.EvalAs<Cell>(0, scope));
-        auto index = args.EvalAs<Number>(1, scope);
-        return list.At(index->GetValue());
-    });
+Value ListRef(Cell* list, int64_t index) {
+    if (index < 0) {
+        throw RuntimeError("Invalid list index");
+    }
+    return ArgList(list).At(index);
+}
 
-    names["list-tail"] = h.Make<BuiltInSyntax>([](auto ast, auto scope){
-        auto args = ArgList(ast).ExpectSize(2);
-        auto list = args.EvalAs<Cell>(0, scope);
-        auto index = args.EvalAs<Number>(1, scope);
-        int value = index->GetValue();
-        while (--value) {
-            list = As<Cell>(list->GetSecond());
-        }
-        return list->GetSecond();
-    });
+Value ListTail(Value list, int64_t index) {
+    for (int64_t i = 0; i < index; ++i) {
+        list = As<Cell>(list)->GetSecond();
+    }
+    return list;
+}
 
-    names["if"] = h.Make<BuiltInSyntaxTailRecursive>([](auto ast, auto scope) -> Object* {
-        auto args = ArgList(ast);
-        if (args.Size() != 2 && args.Size() != 3) {
-            throw SyntaxError("Wrong number of parameters");
-        }
-        auto cond = args.Eval(0, scope);
-        if (EvalToTrue(cond)) {
-            return args.At(1);
-        }
-        if (args.Size() == 3) {
-            return args.At(2);
-        }
-        auto& h = Heap::Instance();
-        return h.Make<Cell>(
-            h.Make<Symbol>("quote"),
-            h.Make<Cell>(nullptr, nullptr)
-        );
-    });
+Value SetCar(Cell* cell, Value value) {
+    RequireMutable(cell);
+    cell->SetFirst(value);
+    return nullptr;
+}
 
-    names["begin"] = h.Make<BuiltInSyntaxTailRecursive>([](auto ast, auto scope){
-        auto args = ArgList(ast).ExpectSizeAtLeast(1);
-        for (size_t i = 0; i < args.Size()-1; ++i) {
-            args.Eval(i, scope);
-        }
-        return args.At(args.Size()-1);
-    });
+Value SetCdr(Cell* cell, Value value) {
+    RequireMutable(cell);
+    cell->SetSecond(value);
+    return nullptr;
+}
 
-    names["lambda"] = h.Make<BuiltInSyntax>([](auto ast, auto scope){
-        auto args = ArgList(ast);
-        if (args.Size() < 2) {
-            throw SyntaxError("Invalid lambda expression.");
-        }
-        auto decl = ArgList(args.At(0));
-        std::vector<Symbol*> formals;
-        for (size_t i = 0; i < decl.Size(); ++i) {
-            formals.push_back(As<Symbol>(decl.At(i)));
-        }
-        auto lambda_ast = Heap::Instance().Make<Cell>(
-            Heap::Instance().Make<Symbol>("begin"),
-            (As<Cell>(ast)->GetSecond())
-        );
-        return Heap::Instance().Make<Lambda>(formals, lambda_ast, scope);
-    });
+Value Display(Value value) {
+    std::cout << ::ToString(value) << std::endl;
+    return nullptr;
+}
 
-    names["define"] = h.Make<BuiltInSyntax>([](auto ast, auto scope){
-        auto args = ArgList(ast);
-        if (args.Size() < 2) {
-            throw SyntaxError("Invalid define expression.");
-        }
-        auto declaration = args.At(0);
-        if (Is<Symbol>(declaration)) {
-            if (args.Size() != 2) {
-                throw SyntaxError("Invalid define expression.");
-            }
-            scope->NewDefinition(As<Symbol>(declaration)->GetName(), args.Eval(1, scope));
-        }
-        else if (Is<Cell>(declaration)) {
-            auto decl = ArgList(declaration);
-            auto name = As<Symbol>(decl.At(0));
-            std::vector<Symbol*> formals;
-            for (size_t i = 1; i < decl.Size(); ++i) {
-                formals.push_back(As<Symbol>(decl.At(i)));
-            }
-            auto lambda_ast = Heap::Instance().Make<Cell>(
-                Heap::Instance().Make<Symbol>("begin"),
-                (As<Cell>(ast)->GetSecond())
-            );
-            scope->NewDefinition(name->GetName(), Heap::Instance().Make<Lambda>(formals, lambda_ast, scope));
-        } else {
-            As<Symbol>(declaration);
-        }
-        return nullptr;
-    });
+Value Load(Symbol* path) {
+    Interpreter::Current()->RunFile(path->GetName());
+    return nullptr;
+}
 
-    names["set!"] = h.Make<BuiltInSyntax>([](auto ast, auto scope){
-        auto args = ArgList(ast);
-        if (args.Size() != 2) {
-            throw SyntaxError("Invalid set! expression.");
-        }
-        auto declaration = As<Symbol>(args.At(0));
-        auto& name = As<Symbol>(declaration)->GetName();
-        scope->SetDefinition(name, args.Eval(1, scope));
-        return nullptr;
-    });
+Value GcStats() { return StatsToList(Heap::Instance().Stats()); }
 
-    names["set-car!"] = h.Make<BuiltInProc<Object>>([](auto& args) {
-        RequireSize<2>(args);
-        As<Cell>(args[0])->SetFirst(args[1]);
-        return nullptr;
-    });
+// The VM calls the procedure with the arguments spread on its stack itself,
+// since it may be a lambda.
+Value Apply(std::span<const Value>) {
+    throw std::logic_error("apply is called by the VM");
+}
 
-    names["set-cdr!"] = h.Make<BuiltInProc<Object>>([](auto& args) {
-        RequireSize<2>(args);
-        As<Cell>(args[0])->SetSecond(args[1]);
-        return nullptr;
-    });
+constexpr Primitive kPrimitives[] = {
+    MakeFixed<IsNull>("null?"),
+    MakeFixed<IsPair>("pair?"),
+    MakeFixed<IsList>("list?"),
+    MakeFixed<IsNumber>("number?"),
+    MakeFixed<IsSymbol>("symbol?"),
+    MakeFixed<IsBoolean>("boolean?"),
+    MakeFixed<Not>("not"),
+    MakeVariadic("+", Add),
+    MakeVariadic("*", Multiply),
+    MakeVariadic("-", Subtract, 1),
+    MakeVariadic("/", Divide, 1),
+    MakeFixed<Abs>("abs"),
+    MakeVariadic("=", Compare<std::equal_to<>>),
+    MakeVariadic("<", Compare<std::less<>>),
+    MakeVariadic(">", Compare<std::greater<>>),
+    MakeVariadic("<=", Compare<std::less_equal<>>),
+    MakeVariadic(">=", Compare<std::greater_equal<>>),
+    MakeVariadic("max", Extremum<std::greater<>>, 1),
+    MakeVariadic("min", Extremum<std::less<>>, 1),
+    MakeFixed<Cons>("cons"),
+    MakeFixed<Car>("car"),
+    MakeFixed<Cdr>("cdr"),
+    MakeVariadic("list", List),
+    MakeFixed<ListRef>("list-ref"),
+    MakeFixed<ListTail>("list-tail"),
+    MakeFixed<SetCar>("set-car!"),
+    MakeFixed<SetCdr>("set-cdr!"),
+    MakeFixed<Display>("display"),
+    MakeFixed<Load>("load"),
+    MakeFixed<GcStats>("gc-stats"),
+    MakeVariadic("apply", Apply, 2),
+};
+
+}  // namespace
+
+// Builtin procedures do not depend on the interpreter, so they are created
+// once and every new global scope starts as a copy of this one.
+static Environment* MakePrimitives() {
+    Heap& h = Heap::Instance();
+    Environment* scope = h.MakePermanent<Environment>();
+    for (auto& primitive : kPrimitives) {
+        auto name = Symbol::Intern(primitive.name);
+        scope->NewDefinition(name, h.MakePermanent<BuiltIn>(name, primitive.function,
+                                                            primitive.min_arity,
+                                                            primitive.max_arity));
+    }
+    return scope;
+}
 
-    names["display"] = h.Make<BuiltInProc<Object>>([](auto& args) {
-        RequireSize<1>(args);
-        std::cout << ::ToString(args[0]) << std::endl;
-        return nullptr;
-    });
+static Environment* Primitives() {
+    static Environment* primitives = MakePrimitives();
+    return primitives;
+}
 
+BuiltIn* BuiltIn::Find(Symbol* name) {
+    auto value = Primitives()->FindDefinition(name);
+    return Is<BuiltIn>(value) ? static_cast<BuiltIn*>(value.GetObject()) : nullptr;
+}
 
-    return scope;
+Environment* Environment::R5RS() {
+    return Heap::Instance().MakeOld<Environment>(*Primitives());
 }
 
-void Environment::NewDefinition(const std::string& name, Object* obj) {
-    names_[name] = obj;
+uint64_t Environment::NextVersion() {
+    static uint64_t versions = 0;
+    return ++versions;
 }
-void Environment::SetDefinition(const std::string& name, Object* obj) {
-    if (auto it = names_.find(name); it != names_.end()) {
-        it->second = obj;
-        return;
-    }
-    if (parent_) {
-        parent_->SetDefinition(name, obj);
-        return;
+Environment::Environment() : Object(kType), version_(NextVersion()) {}
+Environment::Environment(const Environment& other)
+    : Object(other), values_(other.values_), version_(NextVersion()) {}
+// Redefinitions and set! write to the slot that caches point to, so only
+// growing the slots changes the version.
+void Environment::NewDefinition(Symbol* name, Value value) {
+    if (name->GetId() >= values_.size()) {
+        values_.resize(name->GetId() + 1, Value::Unbound());
+        version_ = NextVersion();
     }
-    throw NameError("Trying to set! undefined variable.");
+    Heap::Instance().WriteBarrier(this, value);
+    values_[name->GetId()] = value;
 }
-void Environment::SetParent(Environment* p) {
-    parent_ = p;
+void Environment::SetDefinition(Symbol* name, Value value) {
+    if (name->GetId() >= values_.size() || values_[name->GetId()] == Value::Unbound()) {
+        throw NameError("Trying to set! undefined variable.");
+    }
+    Heap::Instance().WriteBarrier(this, value);
+    values_[name->GetId()] = value;
 }
-Object* Environment::Eval(Environment*) {
-    throw RuntimeError("Trying to evaluate Environment");
+std::vector<std::pair<Symbol*, Value>> Environment::GetDefinitions() const {
+    std::vector<std::pair<Symbol*, Value>> definitions;
+    for (size_t id = 0; id < values_.size(); ++id) {
+        if (values_[id] != Value::Unbound()) {
+            definitions.emplace_back(Symbol::FromId(id), values_[id]);
+        }
+    }
+    return definitions;
 }
 std::string Environment::ToString() const {
     std::string str = "Environment { ";
-    for (auto [k, v] : names_) {
-        (str += k) += " ";
+    for (size_t id = 0; id < values_.size(); ++id) {
+        if (values_[id] != Value::Unbound()) {
+            (str += Symbol::FromId(id)->GetName()) += " ";
+        }
     }
     return str + "}";
 }
-Object* Environment::GetDefinition(const std::string& name) {
-    if (auto it = names_.find(name); it != names_.end()) {
-        return it->second;
+Value Environment::GetDefinition(Symbol* name) {
+    auto value = FindDefinition(name);
+    if (value == Value::Unbound()) {
+        throw NameError("Invalid name: " + name->GetName());
     }
-    if (parent_) {
-        return parent_->GetDefinition(name);
+    return value;
+}
+const Value* Environment::GetSlot(Symbol* name) const {
+    if (FindDefinition(name) == Value::Unbound()) {
+        throw NameError("Invalid name: " + name->GetName());
     }
-    throw NameError("Invalid name: " + name);
+    return &values_[name->GetId()];
 }
-void Environment::MarkDependencies() {
-    for (auto& [k, v] : names_) {
-        Heap::Instance().Mark(v);
+Value Environment::FindDefinition(Symbol* name) const {
+    if (name->GetId() >= values_.size()) {
+        return Value::Unbound();
     }
-}
\ No newline at end of file
+    return values_[name->GetId()];
+}
+void Environment::Trace(Tracer& tracer) {
+    for (auto& v : values_) {
+        tracer.Visit(v);
+    }
+}
@@ -2,70 +2,193 @@
 #include <scheme/error.h>
 #include <scheme/heap.h>
 
-Object* ReadList(Tokenizer *tokenizer) {
-    Heap& h = Heap::Instance();
+#include <vector>
 
-    if (tokenizer->IsEnd()) {
-        throw SyntaxError("Tokenizer is end");
-    }
-    Token next_token = tokenizer->GetToken();
-    if (auto* ptr = std::get_if<BracketToken>(&next_token)) {
-        if (*ptr == BracketToken::CLOSE) {
-            tokenizer->Next();
-            return nullptr;
+// A list or quote whose elements are still being read.
+struct PendingDatum {
+    enum class Kind { LIST, QUOTE };
+
+    Kind kind;
+    Cell* head = nullptr;
+    Cell* tail = nullptr;
+    // The datum after a dot ends the list, and nothing may follow it.
+    bool dotted = false;
+    bool has_rest = false;
+};
+
+// Builds lists front to back, linking every new cell to the tail of the one
+// before, so that neither the length nor the nesting of a datum takes C++ stack.
+Value Read(Tokenizer *tokenizer, size_t max_depth) {
+    Heap& h = Heap::Instance();
+    std::vector<PendingDatum> pending;
+    auto push = [&](PendingDatum::Kind kind) {
+        if (pending.size() >= max_depth) {
+            throw SyntaxError("Datum nested too deeply");
         }
-    }
-    Object* first = Read(tokenizer);
-    if (tokenizer->IsEnd()) {
-        throw SyntaxError("Tokenizer is end");
-    }
-    next_token = tokenizer->GetToken();
-    if (auto* ptr = std::get_if<DotToken>(&next_token)) {
-        tokenizer->Next();
-        Object* second = Read(tokenizer);
+        pending.push_back(PendingDatum{kind});
+    };
+
+    while (true) {
         if (tokenizer->IsEnd()) {
             throw SyntaxError("Tokenizer is end");
         }
-        next_token = tokenizer->GetToken();
-        if (auto* ptr2 = std::get_if<BracketToken>(&next_token)) {
-            if (*ptr2 != BracketToken::CLOSE) {
-                throw SyntaxError("Missing )");
+        Value datum;
+        Token next_token = tokenizer->GetToken();
+        if (auto* ptr = std::get_if<SymbolToken>(&next_token)) {
+            // The name refers to the tokenizer input, so it is used up before moving on.
+            auto name = ptr->name;
+            if (name.starts_with('|')) {
+                name = name.substr(1, name.size() - 2);
             }
+            datum = ptr->name == "#t"   ? Value::True()
+                    : ptr->name == "#f" ? Value::False()
+                                        : Value(Symbol::Intern(name));
+            tokenizer->Next();
+        } else if (auto* ptr = std::get_if<ConstantToken>(&next_token)) {
+            datum = MakeInteger(ptr->value);
+            tokenizer->Next();
+        } else if (std::holds_alternative<QuoteToken>(next_token)) {
+            push(PendingDatum::Kind::QUOTE);
+            tokenizer->Next();
+            continue;
+        } else if (next_token == Token{BracketToken::OPEN}) {
+            push(PendingDatum::Kind::LIST);
+            tokenizer->Next();
+            continue;
+        } else if (std::holds_alternative<BracketToken>(next_token)) {
+            if (pending.empty() || pending.back().kind != PendingDatum::Kind::LIST) {
+                throw SyntaxError("Unexpected ')' detected");
+            }
+            auto& list = pending.back();
+            if (list.dotted && not list.has_rest) {
+                throw SyntaxError("Missing datum after '.'");
+            }
+            datum = list.head;
+            pending.pop_back();
+            tokenizer->Next();
         } else {
+            if (pending.empty() || pending.back().kind != PendingDatum::Kind::LIST ||
+                not pending.back().head || pending.back().dotted) {
+                throw SyntaxError("Unexpected '.' detected");
+            }
+            pending.back().dotted = true;
+            tokenizer->Next();
+            continue;
+        }
+
+        // Hand the complete datum to the ones it is part of.
+        while (not pending.empty() && pending.back().kind == PendingDatum::Kind::QUOTE) {
+            datum = h.Make<Cell>(Symbol::Intern("quote"), h.Make<Cell>(datum, nullptr));
+            pending.pop_back();
+        }
+        if (pending.empty()) {
+            return datum;
+        }
+        auto& list = pending.back();
+        if (list.has_rest) {
             throw SyntaxError("Missing )");
         }
-        tokenizer->Next();
-        return h.Make<Cell>(first, second);
+        if (list.dotted) {
+            list.tail->SetSecond(datum);
+            list.has_rest = true;
+            continue;
+        }
+        auto cell = h.Make<Cell>(datum, nullptr);
+        if (list.tail) {
+            list.tail->SetSecond(cell);
+        } else {
+            list.head = cell;
+        }
+        list.tail = cell;
     }
-    return h.Make<Cell>(first, ReadList(tokenizer));
 }
 
-Object* Read(Tokenizer *tokenizer) {
-    Heap& h = Heap::Instance();
+static bool IsBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
 
-    if (tokenizer->IsEnd()) {
-        throw SyntaxError("Tokenizer is end");
-    }
+Reader::Reader(std::string_view source) : input_(source), finished_(true) {}
 
-    Token next_token = tokenizer->GetToken();
-    tokenizer->Next();
-    if (auto* ptr = std::get_if<ConstantToken>(&next_token)) {
-        return h.Make<Number>(ptr->value);
-    }
-    if (auto* ptr = std::get_if<SymbolToken>(&next_token)) {
-        return h.Make<Symbol>(std::move(ptr->name));
+void Reader::Feed(std::string_view chunk) {
+    // Drop what has been read. Only the unfinished datum has to stay.
+    buffer_.erase(0, start_);
+    pos_ -= start_;
+    start_ = 0;
+    buffer_ += chunk;
+    input_ = buffer_;
+}
+
+void Reader::Finish() {
+    finished_ = true;
+}
+
+void Reader::Clear() {
+    buffer_.clear();
+    input_ = buffer_;
+    start_ = pos_ = depth_ = 0;
+    in_atom_ = in_bars_ = finished_ = false;
+}
+
+bool Reader::HasPartial() const {
+    for (auto c : input_.substr(start_)) {
+        if (not IsBlank(c)) {
+            return true;
+        }
     }
-    if (auto* ptr = std::get_if<BracketToken>(&next_token)) {
-        switch (*ptr) {
-            case BracketToken::OPEN: return ReadList(tokenizer);
-            case BracketToken::CLOSE: throw SyntaxError("Unexpected ')' detected");
+    return false;
+}
+
+// Only brackets, quotes, bars and blanks are told apart here. Read finds out what
+// the datum holds and whether it is well-formed.
+std::optional<Value> Reader::Next() {
+    while (pos_ < input_.size()) {
+        char c = input_[pos_];
+        bool delimiter = not in_bars_ && (IsBlank(c) || c == '(' || c == ')' || c == '\'');
+        if (in_atom_ && delimiter) {
+            in_atom_ = false;
+            if (depth_ == 0) {
+                return Parse(pos_);
+            }
+        }
+        ++pos_;
+        if (c == '|') {
+            in_bars_ = not in_bars_;
+            in_atom_ = true;
+        } else if (in_bars_) {
+            continue;
+        } else if (IsBlank(c)) {
+            // Blanks before a datum are skipped.
+            if (start_ + 1 == pos_) {
+                start_ = pos_;
+            }
+        } else if (c == '(') {
+            ++depth_;
+        } else if (c == ')') {
+            // A stray bracket is a datum of its own, which Read rejects.
+            if (depth_ == 0 || --depth_ == 0) {
+                return Parse(pos_);
+            }
+        } else if (c != '\'') {
+            in_atom_ = true;
         }
     }
-    if (auto* ptr = std::get_if<QuoteToken>(&next_token)) {
-        return h.Make<Cell>(h.Make<Symbol>("quote"), h.Make<Cell>(Read(tokenizer), nullptr));
+    if (finished_ && HasPartial()) {
+        return Parse(input_.size());
     }
-    if (auto* ptr = std::get_if<DotToken>(&next_token)) {
-        throw SyntaxError("Unexpected '.' detected");
+    return std::nullopt;
+}
+
+Value Reader::Parse(size_t end) {
+    auto datum = input_.substr(start_, end - start_);
+    start_ = pos_ = end;
+    depth_ = 0;
+    in_atom_ = in_bars_ = false;
+
+    Tokenizer tokenizer{datum};
+    auto value = Read(&tokenizer, max_depth_);
+    // Like 1.5, which is split into 1, a dot and 5.
+    if (not tokenizer.IsEnd()) {
+        throw SyntaxError("Unexpected token after datum");
     }
-    throw SyntaxError("Unknown token detected");
-}
\ No newline at end of file
+    return value;
+}
@@ -0,0 +1,127 @@
+#include <scheme/profiler.h>
+
+#include <algorithm>
+#include <map>
+
+#include <sys/time.h>
+#include <time.h>
+
+void Profiler::Start(std::chrono::microseconds interval) {
+    Stop();
+    samples_.resize(kSampleCapacity);
+    samples_size_ = 0;
+    dropped_ = 0;
+    for (size_t id = 0; id < Symbol::Count(); ++id) {
+        Symbol::FromId(id)->calls_ = 0;
+    }
+    depth_ = 0;
+    running_ = true;
+    start_time_ = GetCpuTime();
+
+    struct sigaction action {};
+    action.sa_handler = OnSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &previous_action_);
+    itimerval timer{};
+    timer.it_interval.tv_sec = interval.count() / 1'000'000;
+    timer.it_interval.tv_usec = interval.count() % 1'000'000;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+void Profiler::Stop() {
+    if (not running_) {
+        return;
+    }
+    itimerval timer{};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sigaction(SIGPROF, &previous_action_, nullptr);
+    running_ = false;
+    cpu_time_ = GetCpuTime() - start_time_;
+}
+
+std::chrono::nanoseconds Profiler::GetCpuTime() const {
+    timespec now{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return std::chrono::seconds{now.tv_sec} + std::chrono::nanoseconds{now.tv_nsec};
+}
+
+void Profiler::OnSignal(int) {
+    Instance().TakeSample();
+}
+
+// Runs in the signal handler, so it only copies into memory reserved by Start.
+void Profiler::TakeSample() {
+    auto depth = std::min(depth_.load(std::memory_order_relaxed), kMaxDepth);
+    std::atomic_signal_fence(std::memory_order_acquire);
+    auto size = samples_size_.load(std::memory_order_relaxed);
+    if (size + depth + 1 > samples_.size()) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    std::copy_n(stack_.begin(), depth, samples_.begin() + size);
+    samples_[size + depth] = nullptr;
+    samples_size_.store(size + depth + 1, std::memory_order_relaxed);
+}
+
+void Profiler::WriteFolded(std::ostream& out) const {
+    std::map<std::string, size_t> stacks;
+    std::string stack;
+    for (size_t i = 0, size = samples_size_; i < size; ++i) {
+        if (samples_[i]) {
+            stack += (stack.empty() ? "" : ";") + samples_[i]->GetName();
+            continue;
+        }
+        ++stacks[stack.empty() ? "toplevel" : stack];
+        stack.clear();
+    }
+    for (auto& [line, count] : stacks) {
+        out << line << ' ' << count << '\n';
+    }
+}
+
+std::vector<Profiler::Procedure> Profiler::GetProcedures() const {
+    std::vector<size_t> inclusive(Symbol::Count());
+    std::vector<size_t> exclusive(Symbol::Count());
+    // Recursive calls put a procedure on a stack several times, but it is
+    // included in the sample only once.
+    std::vector<size_t> last_sample(Symbol::Count(), SIZE_MAX);
+    size_t sample = 0;
+    for (size_t i = 0, size = samples_size_; i < size; ++i) {
+        if (not samples_[i]) {
+            if (i > 0 && samples_[i - 1]) {
+                ++exclusive[samples_[i - 1]->GetId()];
+            }
+            ++sample;
+            continue;
+        }
+        auto id = samples_[i]->GetId();
+        if (last_sample[id] != sample) {
+            last_sample[id] = sample;
+            ++inclusive[id];
+        }
+    }
+
+    auto cpu_time = running_ ? GetCpuTime() - start_time_ : cpu_time_;
+    auto time = [&](size_t samples) {
+        return cpu_time * samples / std::max<size_t>(sample + dropped_, 1);
+    };
+    std::vector<Procedure> procedures;
+    for (size_t id = 0; id < Symbol::Count(); ++id) {
+        auto symbol = Symbol::FromId(id);
+        if (symbol->calls_ == 0 && inclusive[id] == 0) {
+            continue;
+        }
+        procedures.push_back(Procedure{symbol->GetName(), symbol->calls_, time(inclusive[id]),
+                                       time(exclusive[id])});
+    }
+    std::stable_sort(procedures.begin(), procedures.end(), [](auto& lhs, auto& rhs) {
+        return lhs.exclusive > rhs.exclusive;
+    });
+    return procedures;
+}
+
+size_t Profiler::GetSampleCount() const {
+    return std::count(samples_.begin(), samples_.begin() + samples_size_, nullptr);
+}
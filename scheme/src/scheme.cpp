@@ -1,26 +1,120 @@
 #include <scheme/scheme.h>
 #include <scheme/tokenizer.h>
 #include <scheme/parser.h>
+#include <scheme/compiler.h>
+#include <scheme/vm.h>
+#include <scheme/image.h>
+#include <scheme/mapped_file.h>
 
 #include <scheme/heap.h>
 #include <scheme/error.h>
 
-#include <sstream>
+#include <utility>
 
+thread_local Interpreter* Interpreter::current_ = nullptr;
+
+Interpreter::Interpreter() : global_scope_(Environment::R5RS()), vm_(global_scope_.Get()) {}
+
+Interpreter::~Interpreter() = default;
+
+Value Interpreter::Eval(Value ast, CodeArena* arena) {
+    // Builtins like load find the interpreter that calls them here.
+    struct CurrentGuard {
+        Interpreter* previous;
+        ~CurrentGuard() {
+            current_ = previous;
+        }
+    } guard{std::exchange(current_, this)};
+    return vm_.Run(Compile(ast, arena));
+}
+
+namespace {
+
+// Forms read ahead of their evaluation, which the collector keeps alive and
+// up to date while the earlier ones run.
+class Forms : public RootSet {
+    std::vector<Value> forms_;
+
+public:
+    Forms() {
+        Heap::Instance().AddRootSet(this);
+    }
+    ~Forms() {
+        Heap::Instance().RemoveRootSet(this);
+    }
+    Forms(const Forms&) = delete;
+    Forms& operator=(const Forms&) = delete;
+
+    void Add(Value form) { forms_.push_back(form); }
+    size_t Size() const { return forms_.size(); }
+    Value At(size_t i) const { return forms_[i]; }
+
+    void TraceRoots(Tracer& tracer) override {
+        for (auto& form : forms_) {
+            tracer.Visit(form);
+        }
+    }
+};
+
+}  // namespace
+
+// Reading collects nothing, so the forms only need a root once the first one
+// runs. Collecting between forms is safe even when load runs this: the VM
+// that called it keeps its whole state in its roots while a builtin runs.
+std::string Interpreter::EvalAll(Reader *reader, CodeArena *arena) {
+    Forms forms;
+    while (auto ast = reader->Next()) {
+        forms.Add(*ast);
+    }
+    std::string result;
+    for (size_t i = 0; i < forms.Size(); ++i) {
+        result = ToString(Eval(forms.At(i), arena));
+        Heap::Instance().Collect();
+    }
+    return result;
+}
 
 std::string Interpreter::Run(const std::string &str) {
-    std::stringstream ss{str};
-    Tokenizer tokenizer(&ss);
-
-    auto ast = Read(&tokenizer);
-    auto eval = Eval(ast, global_scope_);
-    std::string result = ToString(eval);
-    Heap::Instance().Mark(global_scope_);
-    Heap::Instance().Sweep();
+    Reader reader{std::string_view(str)};
+    if (not reader.HasPartial()) {
+        throw SyntaxError("Nothing to evaluate");
+    }
+    return EvalAll(&reader);
+}
+
+std::string Interpreter::RunFile(const std::string &path) {
+    MappedFile file(path);
+    Reader reader{file.View()};
+    return EvalAll(&reader, &CodeArena::Instance());
+}
+
+void Interpreter::SaveImage(const std::string &path) {
+    Image::Save(global_scope_.Get(), path);
+}
+
+void Interpreter::LoadImage(const std::string &path) {
+    Image::Load(path, global_scope_.Get());
+}
+
+void Interpreter::Feed(std::string_view chunk) {
+    reader_.Feed(chunk);
+}
+
+std::optional<std::string> Interpreter::RunNext() {
+    auto ast = reader_.Next();
+    if (not ast) {
+        return std::nullopt;
+    }
+    std::string result = ToString(Eval(*ast));
+    Heap::Instance().Collect();
     return result;
 }
 
-ArgList::ArgList(Object* ast) {
+bool Interpreter::HasPartialInput() const {
+    return reader_.HasPartial();
+}
+
+ArgList::ArgList(Value ast) {
     is_proper_ = true;
     while (ast) {
         if (Is<Cell>(ast)) {
@@ -67,7 +161,7 @@ std::string ArgList::ToString() {
 bool ArgList::IsProper() const {
     return is_proper_;
 }
-Object* ArgList::At(size_t i) const {
+Value ArgList::At(size_t i) const {
     if (i >= vec_.size()) {
         throw RuntimeError("Too few arguments");
     }
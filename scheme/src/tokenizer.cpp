@@ -1,6 +1,8 @@
 #include <scheme/tokenizer.h>
+#include <scheme/error.h>
 
 #include <cctype>
+#include <charconv>
 
 bool SymbolToken::operator==(const SymbolToken &other) const {
     return name == other.name;
@@ -18,24 +20,59 @@ bool ConstantToken::operator==(const ConstantToken &other) const {
     return value == other.value;
 }
 
+static bool IsSymbolStart(int c) {
+    return std::isalpha(c) || c == '<' || c == '=' || c == '>' || c == '*' || c == '/' || c == '#';
+}
+
+static bool IsSymbolPart(int c) {
+    return IsSymbolStart(c) || std::isdigit(c) || c == '?' || c == '!' || c == '-';
+}
+
 Tokenizer::Tokenizer(std::istream *in) : in_(in) {
     Next();
 }
 
+Tokenizer::Tokenizer(std::string_view source) : source_(source) {
+    Next();
+}
+
 bool Tokenizer::IsEnd() {
     return !current_token_.has_value();
 }
 
+int Tokenizer::Peek() {
+    if (pos_ < source_.size()) {
+        return static_cast<unsigned char>(source_[pos_]);
+    }
+    if (not in_) {
+        return EOF;
+    }
+    int c = in_->get();
+    if (c == EOF) {
+        return EOF;
+    }
+    buffer_.push_back(static_cast<char>(c));
+    source_ = buffer_;
+    return c;
+}
+
 void Tokenizer::Next() {
+    if (in_) {
+        // The previous token is no longer referenced.
+        buffer_.erase(0, pos_);
+        source_ = buffer_;
+        pos_ = 0;
+    }
     int next_char;
-    do {
-        if (in_->eof()) {
-            current_token_.reset();
-            return;
-        }
-        next_char = in_->get();
-    } while (std::isblank(next_char) || next_char == '\n' || next_char == '\r');
+    while (std::isblank(next_char = Peek()) || next_char == '\n' || next_char == '\r') {
+        ++pos_;
+    }
+    if (next_char == EOF) {
+        current_token_.reset();
+        return;
+    }
 
+    auto start = pos_++;
     if (next_char == '(') {
         current_token_ = Token{BracketToken::OPEN};
     } else if (next_char == ')') {
@@ -45,32 +82,19 @@ void Tokenizer::Next() {
     } else if (next_char == '\'') {
         current_token_ = Token{QuoteToken{}};
     } else if (std::isdigit(next_char)) {
-        in_->unget();
-        current_token_ = Token{ReadConstant()};
-    } else if (next_char == '+') {
-        next_char = in_->get();
-        in_->unget();
-        if (std::isdigit(next_char)) {
-            current_token_ = Token{ReadConstant()};
+        current_token_ = Token{ReadConstant(start)};
+    } else if (next_char == '+' || next_char == '-') {
+        if (std::isdigit(Peek())) {
+            current_token_ = Token{ReadConstant(start)};
         } else {
-            current_token_ = Token{SymbolToken{"+"}};
+            current_token_ = Token{SymbolToken{source_.substr(start, 1)}};
         }
-    } else if (next_char == '-') {
-        next_char = in_->get();
-        in_->unget();
-        if (std::isdigit(next_char)) {
-            in_->unget(); // return minus to stream
-            current_token_ = Token{ReadConstant()};
-        } else {
-            current_token_ = Token{SymbolToken{"-"}};
-        }
-    } else if (std::isalpha(next_char)
-               || next_char == '<' || next_char == '=' || next_char == '>'
-               || next_char == '*' || next_char == '/' || next_char == '#') {
-        in_->unget();
-        current_token_ = Token{ReadSymbol()};
+    } else if (IsSymbolStart(next_char)) {
+        current_token_ = Token{ReadSymbol(start)};
+    } else if (next_char == '|') {
+        current_token_ = Token{ReadVerbatimSymbol(start)};
     } else {
-        current_token_.reset();
+        throw SyntaxError("Unexpected character");
     }
 }
 
@@ -78,22 +102,38 @@ Token Tokenizer::GetToken() {
     return *current_token_;
 }
 
-ConstantToken Tokenizer::ReadConstant() {
-    int value;
-    *in_ >> value;
+ConstantToken Tokenizer::ReadConstant(size_t start) {
+    while (std::isdigit(Peek())) {
+        ++pos_;
+    }
+    // from_chars does not accept a plus sign.
+    if (source_[start] == '+') {
+        ++start;
+    }
+    int64_t value;
+    auto first = source_.data() + start;
+    auto [end, error] = std::from_chars(first, source_.data() + pos_, value);
+    if (error != std::errc{}) {
+        throw SyntaxError("Integer literal out of range");
+    }
     return ConstantToken{value};
 }
 
-SymbolToken Tokenizer::ReadSymbol() {
-    std::string name;
-    int c = in_->get();
-    while (std::isalnum(c)
-           || c == '<' || c == '=' || c == '>'
-           || c == '*' || c == '/' || c == '#'
-           || c == '?' || c == '!' || c == '-') {
-        name.push_back(c);
-        c = in_->get();
+SymbolToken Tokenizer::ReadSymbol(size_t start) {
+    while (IsSymbolPart(Peek())) {
+        ++pos_;
+    }
+    return SymbolToken{source_.substr(start, pos_ - start)};
+}
+
+SymbolToken Tokenizer::ReadVerbatimSymbol(size_t start) {
+    int c;
+    while ((c = Peek()) != '|') {
+        if (c == EOF) {
+            throw SyntaxError("Missing '|' after symbol");
+        }
+        ++pos_;
     }
-    in_->unget();
-    return SymbolToken{name};
+    ++pos_;
+    return SymbolToken{source_.substr(start, pos_ - start)};
 }
@@ -0,0 +1,240 @@
+#include <scheme/vm.h>
+#include <scheme/heap.h>
+
+VM::VM(Environment* global_scope) : global_scope_(global_scope) {
+    stack_.reserve(kStackReserve);
+    frames_.reserve(kStackReserve);
+    Heap::Instance().AddRootSet(this);
+}
+
+VM::~VM() {
+    Heap::Instance().RemoveRootSet(this);
+}
+
+void VM::TraceRoots(Tracer& tracer) {
+    tracer.Visit(global_scope_);
+    for (auto& value : stack_) {
+        tracer.Visit(value);
+    }
+    for (auto& frame : frames_) {
+        tracer.Visit(frame.code);
+        tracer.Visit(frame.frame);
+        tracer.Visit(frame.callee);
+    }
+}
+
+void VM::SafePoint() {
+    auto& heap = Heap::Instance();
+    if (heap.IsCollectionRequested()) {
+        heap.Collect();
+    }
+}
+
+Value VM::Pop() {
+    auto o = stack_.back();
+    stack_.pop_back();
+    return o;
+}
+
+Value VM::Run(Code* code) {
+    // Calls that an error interrupts are never left, so the stacks and the
+    // profiler stack are reset to where they were.
+    struct Guard {
+        VM* vm;
+        size_t frames = vm->frames_.size();
+        size_t stack = vm->stack_.size();
+        size_t profiler = vm->profiler_.GetDepth();
+        ~Guard() {
+            vm->frames_.resize(frames);
+            vm->stack_.resize(stack);
+            vm->profiler_.Unwind(profiler);
+        }
+    } guard{this};
+    frames_.push_back(CallFrame{code, 0, nullptr, nullptr, stack_.size()});
+    // A run that load starts from a builtin picks its own loop, so it leaves
+    // the profiling of the run around it as it was.
+    if (profiler_.IsRunning()) [[unlikely]] {
+        return Execute<true>(guard.frames);
+    }
+    return Execute<false>(guard.frames);
+}
+
+template <bool kProfiling>
+Value VM::Execute(size_t frames) {
+    while (true) {
+        auto& frame = frames_.back();
+        auto instruction = frame.code->At(frame.pc++);
+        switch (instruction.op) {
+            case OpCode::CONSTANT:
+                stack_.push_back(frame.code->GetConstant(instruction.arg));
+                break;
+            case OpCode::LOAD_LOCAL: {
+                auto value = frame.frame->Get(instruction.depth, instruction.arg);
+                if (value == Value::Unbound()) {
+                    throw NameError("Variable used before its definition");
+                }
+                stack_.push_back(value);
+                break;
+            }
+            case OpCode::LOAD_GLOBAL: {
+                auto& cache = frame.code->GetCache(instruction.arg);
+                auto version = global_scope_->GetVersion();
+                if (cache.scope != global_scope_ || cache.version != version) {
+                    auto name = As<Symbol>(frame.code->GetConstant(instruction.arg));
+                    cache = {global_scope_, version, global_scope_->GetSlot(name)};
+                }
+                stack_.push_back(*cache.slot);
+                break;
+            }
+            case OpCode::DEFINE_LOCAL:
+                frame.frame->Set(0, instruction.arg, Pop());
+                stack_.push_back(nullptr);
+                break;
+            case OpCode::DEFINE_GLOBAL: {
+                auto name = As<Symbol>(frame.code->GetConstant(instruction.arg));
+                global_scope_->NewDefinition(name, Pop());
+                stack_.push_back(nullptr);
+                break;
+            }
+            case OpCode::SET_LOCAL:
+                if (frame.frame->Get(instruction.depth, instruction.arg) == Value::Unbound()) {
+                    throw NameError("Trying to set! undefined variable.");
+                }
+                frame.frame->Set(instruction.depth, instruction.arg, Pop());
+                stack_.push_back(nullptr);
+                break;
+            case OpCode::SET_GLOBAL: {
+                auto name = As<Symbol>(frame.code->GetConstant(instruction.arg));
+                global_scope_->SetDefinition(name, Pop());
+                stack_.push_back(nullptr);
+                break;
+            }
+            case OpCode::POP:
+                stack_.pop_back();
+                break;
+            case OpCode::JUMP:
+                frame.pc = instruction.arg;
+                break;
+            case OpCode::JUMP_IF_FALSE:
+                if (not Pop().IsTrue()) {
+                    frame.pc = instruction.arg;
+                }
+                break;
+            case OpCode::JUMP_IF_FALSE_KEEP:
+                if (not stack_.back().IsTrue()) {
+                    frame.pc = instruction.arg;
+                } else {
+                    stack_.pop_back();
+                }
+                break;
+            case OpCode::JUMP_IF_TRUE_KEEP:
+                if (stack_.back().IsTrue()) {
+                    frame.pc = instruction.arg;
+                } else {
+                    stack_.pop_back();
+                }
+                break;
+            case OpCode::MAKE_LAMBDA: {
+                auto body = As<Code>(frame.code->GetConstant(instruction.arg));
+                stack_.push_back(Heap::Instance().Make<Lambda>(body, frame.frame));
+                break;
+            }
+            case OpCode::CALL:
+                SafePoint();
+                Call<kProfiling>(instruction.arg, false);
+                break;
+            case OpCode::TAIL_CALL:
+                SafePoint();
+                Call<kProfiling>(instruction.arg, true);
+                break;
+            case OpCode::RETURN: {
+                if (kProfiling && frame.callee) {
+                    profiler_.Leave();
+                }
+                auto result = Pop();
+                stack_.resize(frame.base);
+                frames_.pop_back();
+                stack_.push_back(result);
+                if (frames_.size() == frames) {
+                    return Pop();
+                }
+                break;
+            }
+        }
+    }
+}
+
+template <bool kProfiling>
+void VM::Call(uint32_t argc, bool tail) {
+    auto callee = stack_[stack_.size() - argc - 1];
+    if (Is<BuiltIn>(callee)) {
+        static BuiltIn* const apply = BuiltIn::Find(Symbol::Intern("apply"));
+        auto builtin = As<BuiltIn>(callee);
+        if (builtin == apply) {
+            Call<kProfiling>(SpreadApplyArguments(argc), tail);
+            return;
+        }
+        if constexpr (kProfiling) {
+            profiler_.Enter(builtin->GetName());
+        }
+        auto result = builtin->Call(std::span(stack_).last(argc));
+        if constexpr (kProfiling) {
+            profiler_.Leave();
+        }
+        stack_.resize(stack_.size() - argc - 1);
+        stack_.push_back(result);
+        return;
+    }
+    auto lambda = As<Lambda>(callee);
+    auto frame = BindArguments(lambda, argc);
+    stack_.resize(stack_.size() - argc - 1);
+
+    // A call in tail position replaces the frame of the procedure that makes
+    // it, so loops through any number of procedures run in constant space.
+    // Top-level code keeps its frame, which marks where Run returns.
+    auto& current = frames_.back();
+    if (tail && current.callee) {
+        if constexpr (kProfiling) {
+            profiler_.TailCall(lambda->GetCode()->GetName());
+        }
+        current = CallFrame{lambda->GetCode(), 0, frame, lambda, current.base};
+        stack_.resize(current.base);
+        return;
+    }
+    if constexpr (kProfiling) {
+        profiler_.Enter(lambda->GetCode()->GetName());
+    }
+    frames_.push_back(CallFrame{lambda->GetCode(), 0, frame, lambda, stack_.size()});
+}
+
+// Turns (apply f a ... list) on the stack into (f a ... elements of list) and
+// returns the new number of arguments.
+uint32_t VM::SpreadApplyArguments(uint32_t argc) {
+    if (argc < 2) {
+        throw RuntimeError("Invalid function call.");
+    }
+    auto list = Pop();
+    stack_.erase(stack_.end() - argc);
+    argc -= 2;
+    for (; Is<Cell>(list); list = As<Cell>(list)->GetSecond()) {
+        stack_.push_back(As<Cell>(list)->GetFirst());
+        ++argc;
+    }
+    if (list) {
+        throw RuntimeError("apply expects a list");
+    }
+    return argc;
+}
+
+Frame* VM::BindArguments(Lambda* lambda, uint32_t argc) {
+    auto code = lambda->GetCode();
+    if (code->GetArity() != argc) {
+        throw RuntimeError("Invalid function call");
+    }
+    auto frame = Heap::Instance().Make<Frame>(code->GetFrameSize(), lambda->GetParentFrame());
+    auto args = stack_.end() - argc;
+    for (size_t i = 0; i < argc; ++i) {
+        frame->Set(0, i, args[i]);
+    }
+    return frame;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <thread>
+
+#include <scheme/heap.h>
+
+// Changes settings of the heap that all tests share, and restores the
+// defaults when it goes out of scope, also when a check of the test fails.
+class HeapSettings {
+public:
+    HeapSettings() = default;
+    HeapSettings(const HeapSettings&) = delete;
+    HeapSettings& operator=(const HeapSettings&) = delete;
+
+    ~HeapSettings() {
+        auto& heap = Heap::Instance();
+        heap.SetMarkSlice(Heap::kDefaultMarkSlice);
+        heap.SetMarkThreads(std::thread::hardware_concurrency());
+        heap.SetCompacting(false);
+    }
+
+    void SetMarkSlice(size_t budget) { Heap::Instance().SetMarkSlice(budget); }
+    void SetMarkThreads(size_t threads) { Heap::Instance().SetMarkThreads(threads); }
+    void SetCompacting(bool compacting) { Heap::Instance().SetCompacting(compacting); }
+};
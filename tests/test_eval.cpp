@@ -11,3 +11,47 @@ TEST_CASE_METHOD(SchemeTest, "Be careful") {
     ExpectRuntimeError("('() ())");
     ExpectEq("'(())", "(())");
 }
+
+TEST_CASE("Redefining a builtin does not affect other interpreters") {
+    {
+        Interpreter interpreter;
+        interpreter.Run("(define + -)");
+        interpreter.Run("(set! car cdr)");
+        REQUIRE(interpreter.Run("(+ 1 2)") == "-1");
+    }
+    Interpreter interpreter;
+    REQUIRE(interpreter.Run("(+ 1 2)") == "3");
+    REQUIRE(interpreter.Run("(car '(1 2))") == "1");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Run evaluates every form") {
+    ExpectEq("(define x 1) (set! x (+ x 1)) x", "2");
+    ExpectEq("x 3", "3");
+    ExpectSyntaxError("  ");
+    // Nothing runs unless every form is complete and well-formed.
+    ExpectSyntaxError("(define y 1) (+ y");
+    ExpectSyntaxError("(define y 1) (1 . )");
+    ExpectNameError("y");
+    // Forms before one that fails are evaluated.
+    ExpectRuntimeError("(define y 1) (car y) (define y 2)");
+    ExpectEq("y", "1");
+}
+
+TEST_CASE("Forms fed in chunks") {
+    Interpreter interpreter;
+    interpreter.Feed("(define (f x)\n");
+    REQUIRE(!interpreter.RunNext());
+    REQUIRE(interpreter.HasPartialInput());
+
+    interpreter.Feed("  (* x 2)) (f 1) (f");
+    REQUIRE(interpreter.RunNext() == "()");
+    REQUIRE(interpreter.RunNext() == "2");
+    REQUIRE(!interpreter.RunNext());
+
+    interpreter.Feed(" 2) (car 1) (f 3)\n");
+    REQUIRE(interpreter.RunNext() == "4");
+    REQUIRE_THROWS_AS(interpreter.RunNext(), RuntimeError);
+    REQUIRE(interpreter.RunNext() == "6");
+    REQUIRE(!interpreter.RunNext());
+    REQUIRE(!interpreter.HasPartialInput());
+}
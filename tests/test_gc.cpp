@@ -0,0 +1,313 @@
+#include "heap_settings.h"
+#include "scheme_test.h"
+
+#include <numeric>
+#include <random>
+
+#include <scheme/heap.h>
+
+namespace {
+
+// Defines (build n acc), which conses the numbers from 1 to n onto acc, and
+// lets the test change the heap settings.
+class GcTest : public SchemeTest {
+protected:
+    HeapSettings settings_;
+
+public:
+    GcTest() {
+        ExpectNoError("(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))");
+    }
+};
+
+HeapStats::Usage Cells(const HeapStats& stats) {
+    return stats.usage[static_cast<size_t>(ObjectType::CELL)];
+}
+
+// Runs collections until a whole major one has happened. Old numbers make it
+// due; they are in a smaller size class than cells.
+void CollectMajor() {
+    auto& heap = Heap::Instance();
+    HeapSettings settings;
+    settings.SetMarkSlice(0);
+    auto majors = heap.Stats().major_collections;
+    while (heap.Stats().major_collections == majors) {
+        heap.MakeOld<Number>(0);
+        heap.Collect();
+    }
+}
+
+// A cell too large for any size class.
+class LargeCell : public Cell {
+    std::array<std::byte, 1024> padding_{};
+
+public:
+    using Cell::Cell;
+};
+
+}  // namespace
+
+TEST_CASE_METHOD(SchemeTest, "OldPairKeepsYoungValueAlive") {
+    ExpectNoError("(define x (list 1 2))");
+    ExpectNoError("(set-car! x (list 3 4))");
+    ExpectNoError("(set-cdr! (cdr x) (cons 5 '()))");
+    ExpectNoError("(list 6 7 8)");
+    ExpectEq("x", "((3 4) 2 5)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "OldFrameKeepsYoungValueAlive") {
+    ExpectNoError("(define (make-stack) (define items '()) (lambda (x) (set! items (cons x items)) items))");
+    ExpectNoError("(define push (make-stack))");
+    ExpectNoError("(push 1)");
+    ExpectNoError("(push (list 2 3))");
+    ExpectNoError("(list 4 5 6)");
+    ExpectEq("(push 7)", "(7 (2 3) 1)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "RedefinedGlobalKeepsYoungValueAlive") {
+    ExpectNoError("(define x '(1))");
+    ExpectNoError("(set! x (cons 2 x))");
+    ExpectNoError("(define x (cons 3 x))");
+    ExpectNoError("(list 4 5 6)");
+    ExpectEq("x", "(3 2 1)");
+}
+
+TEST_CASE_METHOD(GcTest, "LongListSurvivesPromotion") {
+    ExpectNoError("(define xs (build 10000 '()))");
+    ExpectEq("(list-ref xs 9999)", "10000");
+    for (int i = 0; i < 10; ++i) {
+        ExpectNoError("(build 10000 '())");
+    }
+    ExpectEq("(list-ref xs 5000)", "5001");
+}
+
+TEST_CASE("InterpretersShareHeap") {
+    Interpreter first;
+    Interpreter second;
+    first.Run("(define x (list 1 2))");
+    second.Run("(define x (list 3 4))");
+    first.Run("(set-car! x (list 5))");
+    second.Run("(set-cdr! x (list 6))");
+    REQUIRE(first.Run("x") == "((5) 2)");
+    REQUIRE(second.Run("x") == "(3 6)");
+}
+
+TEST_CASE_METHOD(GcTest, "MarkingLongListDoesNotOverflowStack") {
+    settings_.SetMarkSlice(0);
+    ExpectNoError("(define xs (build 1000000 '()))");
+    ExpectEq("(list-ref xs 999999)", "1000000");
+    ExpectNoError("(define xs (build 1000000 '()))");
+    ExpectNoError("(define xs '())");
+    ExpectNoError("(define xs (build 10 '()))");
+    ExpectEq("xs", "(1 2 3 4 5 6 7 8 9 10)");
+}
+
+TEST_CASE_METHOD(GcTest, "IncrementalMarkingKeepsMovedObjectsAlive") {
+    settings_.SetMarkSlice(1);
+    ExpectNoError("(define (boxes n acc) (if (= n 0) acc (boxes (- n 1) (cons (list (list 0)) acc))))");
+    // The filler starts a major collection and is dropped right away, so the
+    // boxes are marked while the moves below are under way.
+    ExpectNoError("(define b (boxes 64 '()))");
+    ExpectNoError("(define filler (build 2000 '()))");
+    ExpectNoError("(define filler '())");
+    ExpectNoError(R"EOF(
+        (define (move! i j n)
+          (set-car! (list-ref b i) (car (list-ref b j)))
+          (set-car! (list-ref b j) (list n)))
+                    )EOF");
+    ExpectNoError("(define (total l acc) (if (null? l) acc (total (cdr l) (+ acc (car (car (car l)))))))");
+
+    std::vector<int> model(64, 0);
+    std::default_random_engine rng{7};
+    std::uniform_int_distribution<int> box(0, 63);
+    for (int n = 1; n <= 3000; ++n) {
+        auto i = box(rng);
+        auto j = box(rng);
+        ExpectNoError("(move! " + std::to_string(i) + " " + std::to_string(j) + " " +
+                      std::to_string(n) + ")");
+        model[i] = model[j];
+        model[j] = n;
+        ExpectEq("(total b 0)", std::to_string(std::accumulate(model.begin(), model.end(), 0)));
+    }
+    for (int i = 0; i < 64; ++i) {
+        ExpectEq("(car (car (list-ref b " + std::to_string(i) + ")))", std::to_string(model[i]));
+    }
+}
+
+TEST_CASE_METHOD(GcTest, "ObjectsSurviveManyMarkEpochs") {
+    settings_.SetMarkSlice(0);
+    ExpectNoError("(define xs (build 1000 '()))");
+    ExpectNoError("(define ys '())");
+    for (int i = 1; i <= 10; ++i) {
+        // Each round promotes enough to start and finish a major collection.
+        ExpectNoError("(define garbage (build 5000 '()))");
+        ExpectNoError("(set-car! (list-tail xs " + std::to_string(i) + ") (list " +
+                      std::to_string(i) + "))");
+        ExpectNoError("(set! ys (cons " + std::to_string(i) + " ys))");
+    }
+    ExpectEq("(list-ref xs 10)", "(10)");
+    ExpectEq("(list-ref xs 999)", "1000");
+    ExpectEq("ys", "(10 9 8 7 6 5 4 3 2 1)");
+}
+
+TEST_CASE_METHOD(GcTest, "ParallelMarkingKeepsTreesAlive") {
+    settings_.SetMarkThreads(4);
+    ExpectNoError("(define (tree d) (if (= d 0) d (cons (tree (- d 1)) (tree (- d 1)))))");
+    ExpectNoError("(define (leaves t) (if (pair? t) (+ (leaves (car t)) (leaves (cdr t))) 1))");
+    ExpectNoError("(define (graft! t d) (if (= d 0) (set-car! t (tree 3)) (graft! (cdr t) (- d 1))))");
+
+    SECTION("Whole heap at once") {
+        settings_.SetMarkSlice(0);
+    }
+    SECTION("In slices") {
+        settings_.SetMarkSlice(Heap::kMinParallelSlice);
+    }
+    ExpectNoError("(define kept (tree 14))");
+    for (int i = 0; i < 20; ++i) {
+        ExpectNoError("(tree 12)");
+        ExpectNoError("(graft! kept 10)");
+    }
+    ExpectEq("(leaves kept)", "16384");
+}
+
+TEST_CASE_METHOD(SchemeTest, "CollectsDuringLongLoop") {
+    ExpectNoError("(define (loop n acc) (if (= n 0) (car acc) (loop (- n 1) (list n n n))))");
+    ExpectEq("(loop 1000000 '(0))", "1");
+}
+
+TEST_CASE_METHOD(SchemeTest, "CollectsDuringDeepRecursion") {
+    ExpectNoError("(define (range n) (if (= n 0) '() (cons n (range (- n 1)))))");
+    ExpectNoError("(define (sum l acc) (if (null? l) acc (sum (cdr l) (+ acc (car l)))))");
+    ExpectEq("(sum (range 200000) 0)", "20000100000");
+    ExpectNoError("(define xs (range 100000))");
+    ExpectEq("(sum (cons (sum xs 0) (range 100000)) 0)", "10000100000");
+}
+
+TEST_CASE_METHOD(GcTest, "CompactionKeepsDataIntact") {
+    settings_.SetCompacting(true);
+    ExpectNoError("(define (make-counter) (define n 0) (lambda () (set! n (+ n 1)) n))");
+    ExpectNoError("(define counter (make-counter))");
+    ExpectNoError("(counter)");
+    ExpectNoError("(define xs (build 10000 '()))");
+    ExpectNoError("(define shared (list 1 2))");
+    ExpectNoError("(define ys (list shared shared))");
+    for (int i = 0; i < 10; ++i) {
+        ExpectNoError("(build 10000 '())");
+    }
+    Heap::Instance().Compact();
+    ExpectEq("(list-ref xs 9999)", "10000");
+    ExpectEq("(counter)", "2");
+    ExpectNoError("(set-car! (car ys) 3)");
+    ExpectEq("ys", "((3 2) (3 2))");
+    ExpectEq("(build 3 '())", "(1 2 3)");
+}
+
+TEST_CASE("CompactionPlacesListCellsNextToEachOther") {
+    auto& heap = Heap::Instance();
+    Value list = nullptr;
+    for (int i = 0; i < 100; ++i) {
+        list = heap.MakeOld<Cell>(Value::Fixnum(i), list);
+        // Interleaved garbage leaves gaps between the cells.
+        heap.MakeOld<Cell>(nullptr, nullptr);
+    }
+    Root<Cell> root(As<Cell>(list));
+    heap.Compact();
+
+    auto cell = root.Get();
+    auto next = As<Cell>(cell->GetSecond());
+    auto stride = reinterpret_cast<std::byte*>(next) - reinterpret_cast<std::byte*>(cell);
+    REQUIRE(stride > 0);
+    for (int i = 99; i > 0; --i) {
+        REQUIRE(AsInteger(cell->GetFirst()) == i);
+        next = As<Cell>(cell->GetSecond());
+        REQUIRE(reinterpret_cast<std::byte*>(next) - reinterpret_cast<std::byte*>(cell) == stride);
+        cell = next;
+    }
+}
+
+TEST_CASE_METHOD(GcTest, "StatsCountObjectsAndCollections") {
+    auto cells = [](const HeapStats& stats) {
+        return stats.usage[static_cast<size_t>(ObjectType::CELL)];
+    };
+    auto before = Heap::Instance().Stats();
+    ExpectNoError("(define xs (list 1 2 3 4 5 6 7 8 9 10))");
+    auto after = Heap::Instance().Stats();
+    REQUIRE(cells(after).objects >= cells(before).objects + 10);
+    REQUIRE(cells(after).bytes > cells(before).bytes);
+    REQUIRE(after.allocated_bytes > before.allocated_bytes);
+    REQUIRE(after.minor_collections == before.minor_collections + 1);
+    REQUIRE(std::accumulate(after.pauses.begin(), after.pauses.end(), size_t{0}) ==
+            std::accumulate(before.pauses.begin(), before.pauses.end(), size_t{0}) + 1);
+
+    ExpectNoError("(define xs '())");
+    settings_.SetMarkSlice(0);
+    ExpectNoError("(define garbage (build 5000 '()))");
+    ExpectNoError("(define garbage (build 5000 '()))");
+    ExpectNoError("(define garbage '())");
+    Heap::Instance().Compact();
+    auto collected = Heap::Instance().Stats();
+    REQUIRE(collected.major_collections > after.major_collections);
+    REQUIRE(cells(collected).objects < cells(after).objects + 5000);
+}
+
+TEST_CASE_METHOD(SchemeTest, "GcStatsBuiltin") {
+    ExpectEq("(car (car (gc-stats)))", "minor-collections");
+    ExpectEq("(number? (cdr (car (gc-stats))))", "#t");
+    ExpectEq("(car (list-ref (cdr (list-ref (gc-stats) 7)) 1))", "symbol");
+    ExpectRuntimeError("(gc-stats 1)");
+}
+
+TEST_CASE("PoolReusesFreedSlots") {
+    auto& heap = Heap::Instance();
+    // Compaction leaves no free slots behind, so the garbage cell is the last
+    // one of its size class and the first slot freed when its page is swept.
+    heap.Compact();
+    void* garbage = heap.MakeOld<Cell>(nullptr, nullptr);
+    CollectMajor();
+    void* reused = heap.MakeOld<Cell>(nullptr, nullptr);
+    REQUIRE(reused == garbage);
+}
+
+TEST_CASE("PoolUnmapsEmptyPages") {
+    auto& heap = Heap::Instance();
+    heap.Compact();
+    auto before = heap.Stats();
+    for (int i = 0; i < 10000; ++i) {
+        heap.MakeOld<Cell>(nullptr, nullptr);
+    }
+    auto allocated = heap.Stats();
+    REQUIRE(allocated.pages >= before.pages + 5);
+    REQUIRE(allocated.page_bytes > before.page_bytes);
+
+    // The second cycle finishes sweeping the pages of the first one.
+    CollectMajor();
+    CollectMajor();
+    auto collected = heap.Stats();
+    REQUIRE(Cells(collected).objects == Cells(before).objects);
+    // Only the numbers that made the collections due may have taken a page.
+    REQUIRE(collected.pages <= before.pages + 1);
+    REQUIRE(collected.page_bytes < allocated.page_bytes);
+}
+
+TEST_CASE("HeapAllocatesObjectsLargerThanSizeClasses") {
+    auto& heap = Heap::Instance();
+    heap.Compact();
+    auto before = heap.Stats();
+    Root<LargeCell> kept(heap.MakeOld<LargeCell>(Value::Fixnum(1), nullptr));
+    heap.MakeOld<LargeCell>(nullptr, nullptr);
+    auto allocated = heap.Stats();
+    REQUIRE(Cells(allocated).objects == Cells(before).objects + 2);
+    REQUIRE(Cells(allocated).bytes >= Cells(before).bytes + 2 * sizeof(LargeCell));
+    REQUIRE(allocated.page_bytes >= before.page_bytes + 2 * sizeof(LargeCell));
+
+    // A young value stored in a large object survives promotion.
+    kept->SetSecond(heap.Make<Cell>(Value::Fixnum(2), nullptr));
+    heap.Collect();
+    CollectMajor();
+    auto collected = heap.Stats();
+    // The garbage one is freed, the promoted cell took its place in the count.
+    REQUIRE(Cells(collected).objects == Cells(before).objects + 2);
+    REQUIRE(Cells(collected).bytes < Cells(allocated).bytes);
+    REQUIRE(AsInteger(kept->GetFirst()) == 1);
+    REQUIRE(AsInteger(As<Cell>(kept->GetSecond())->GetFirst()) == 2);
+}
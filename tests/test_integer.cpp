@@ -56,6 +56,8 @@ TEST_CASE_METHOD(SchemeTest, "IntegerComparisonEdgeCases") {
     ExpectRuntimeError("(> 1 #t)");
     ExpectRuntimeError("(<= 1 #t)");
     ExpectRuntimeError("(>= 1 #t)");
+    // Every argument is checked, even after the result is known.
+    ExpectRuntimeError("(< 2 1 #t)");
 }
 
 TEST_CASE_METHOD(SchemeTest, "IntegerArithmetics") {
@@ -112,3 +114,12 @@ TEST_CASE_METHOD(SchemeTest, "IntegerAbsEdgeCases") {
     ExpectRuntimeError("(abs #t)");
     ExpectRuntimeError("(abs 1 2)");
 }
+
+TEST_CASE_METHOD(SchemeTest, "IntegerOutsideFixnumRange") {
+    ExpectNoError("(define big (* 1073741824 1073741824 2))");
+    ExpectEq("big", "2305843009213693952");
+    ExpectEq("(- 0 big 1)", "-2305843009213693953");
+    ExpectEq("(- big 1)", "2305843009213693951");
+    ExpectEq("(= (- big 1) (+ (- big 2) 1))", "#t");
+    ExpectEq("(number? (* big 2))", "#t");
+}
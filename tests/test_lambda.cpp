@@ -157,3 +157,98 @@ TEST_CASE_METHOD(SchemeTest, "Redefinition and scoping") {
     ExpectEq("((foobar) 1 2)", "3");
     ExpectEq("(+ 1 2 -3)", "0");
 }
+
+TEST_CASE_METHOD(SchemeTest, "SelfTailCallsInNestedForms") {
+    ExpectNoError(R"EOF(
+        (define (count x)
+            (if (= x 0)
+                0
+                (begin
+                    (and #t (or #f (count (- x 1)))))))
+    )EOF");
+    ExpectEq("(count 100000)", "0");
+}
+
+TEST_CASE_METHOD(SchemeTest, "TailCallsToOtherProcedures") {
+    ExpectNoError("(define (even? n) (if (= n 0) #t (odd? (- n 1))))");
+    ExpectNoError("(define (odd? n) (if (= n 0) #f (even? (- n 1))))");
+    ExpectEq("(even? 1000001)", "#f");
+
+    // Through closures passed as arguments, and apply.
+    ExpectNoError("(define (loop f n) (if (= n 0) 'done (f f (- n 1))))");
+    ExpectEq("(loop (lambda (self n) (and #t (loop self n))) 1000000)", "done");
+    ExpectNoError("(define (spin n) (if (= n 0) 0 (apply spin (list (- n 1)))))");
+    ExpectEq("(spin 1000000)", "0");
+}
+
+TEST_CASE_METHOD(SchemeTest, "GlobalReferencesSeeLaterChanges") {
+    ExpectNoError("(define (g) 1) (define (f) (g))");
+    ExpectEq("(f)", "1");
+    ExpectNoError("(define (g) 2)");
+    ExpectEq("(f)", "2");
+    ExpectNoError("(set! g (lambda () 3))");
+    ExpectEq("(f)", "3");
+
+    // New names grow the global scope, which moves its bindings.
+    for (int i = 0; i < 100; ++i) {
+        ExpectNoError("(define global-" + std::to_string(i) + " " + std::to_string(i) + ")");
+    }
+    ExpectEq("(f)", "3");
+    ExpectNoError("(define (g) global-99)");
+    ExpectEq("(f)", "99");
+    Heap::Instance().Compact();
+    ExpectEq("(f)", "99");
+}
+
+TEST_CASE_METHOD(SchemeTest, "NestedClosuresSeeEnclosingFrames") {
+    ExpectNoError(R"EOF(
+        (define (make-adder a)
+            (lambda (b)
+                (lambda (c)
+                    (define sum (+ a b c))
+                    (set! a (+ a 1))
+                    sum)))
+    )EOF");
+    ExpectNoError("(define add (make-adder 1))");
+    ExpectNoError("(define add-10 (add 10))");
+    ExpectEq("(add-10 100)", "111");
+    ExpectEq("(add-10 100)", "112");
+    ExpectNameError("sum");
+}
+
+TEST_CASE_METHOD(SchemeTest, "InternalDefinitionUsedBeforeItIsEvaluated") {
+    ExpectNoError("(define (foo) (define x y) (define y 1) x)");
+    ExpectNameError("(foo)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "LocalVariablesShadowSpecialForms") {
+    ExpectEq("((lambda (if) (if 1 2)) (lambda (a b) b))", "2");
+    ExpectEq("((lambda (quote) (quote 1)) -)", "-1");
+    ExpectNoError("(define x 5)");
+    ExpectEq("((lambda (define) (define x 1)) +)", "6");
+    ExpectEq("((lambda (define) (define (list x) x)) cons)", "((5) . 5)");
+    ExpectEq("((lambda (lambda) (define f (lambda 3)) f) -)", "-3");
+    ExpectEq("(if #t 1 2)", "1");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Apply") {
+    ExpectEq("(apply + '(1 2 3))", "6");
+    ExpectEq("(apply + 1 2 '(3 4))", "10");
+    ExpectEq("(apply list '())", "()");
+    ExpectEq("(apply (lambda (a b) (- a b)) '(5 3))", "2");
+    ExpectEq("(apply apply (list + '(1 2)))", "3");
+    ExpectNoError("(define (sum-all xs) (if (null? xs) 0 (+ (car xs) (apply sum-all (list (cdr xs))))))");
+    ExpectEq("(sum-all '(1 2 3 4))", "10");
+
+    ExpectRuntimeError("(apply +)");
+    ExpectRuntimeError("(apply + 1)");
+    ExpectRuntimeError("(apply + '(1 . 2))");
+    ExpectRuntimeError("(apply car '(1 2))");
+    ExpectRuntimeError("(apply 1 '())");
+}
+
+TEST_CASE_METHOD(SchemeTest, "ErrorsLeaveTheValueStackUsable") {
+    ExpectNoError("(define (f x) (+ x (car x)))");
+    ExpectRuntimeError("(list 1 2 (f 3))");
+    ExpectEq("(list 1 2 (+ 3 4))", "(1 2 7)");
+}
@@ -1,5 +1,7 @@
 #include "scheme_test.h"
 
+#include <scheme/parser.h>
+
 TEST_CASE_METHOD(SchemeTest, "ListsAreNotSelfEvaliating") {
     ExpectRuntimeError("()");
     ExpectRuntimeError("(1)");
@@ -77,3 +79,25 @@ TEST_CASE_METHOD(SchemeTest, "ListOperations") {
     ExpectRuntimeError("(list-ref '(1 2 3) 10)");
     ExpectRuntimeError("(list-tail '(1 2 3) 10)");
 }
+
+TEST_CASE_METHOD(SchemeTest, "Long literal lists") {
+    std::string list = "'(";
+    for (int i = 0; i < 300000; ++i) {
+        list += std::to_string(i) + " ";
+    }
+    ExpectNoError("(define xs " + list + "))");
+    ExpectEq("(list-ref xs 299999)", "299999");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Deeply nested expressions") {
+    // One level is taken by the quote.
+    auto depth = kDefaultMaxDepth - 1;
+    auto nested = std::string(depth, '(') + std::string(depth, ')');
+    ExpectEq("'" + nested, nested);
+    std::string sum;
+    for (size_t i = 0; i < depth; ++i) {
+        sum += "(+ 1 ";
+    }
+    ExpectEq(sum + "0" + std::string(depth, ')'), std::to_string(depth));
+    ExpectSyntaxError("'(" + nested + ")");
+}
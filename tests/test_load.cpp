@@ -0,0 +1,340 @@
+#include "heap_settings.h"
+#include "scheme_test.h"
+
+#include <scheme/bytecode.h>
+#include <scheme/code_arena.h>
+#include <scheme/parser.h>
+#include <scheme/profiler.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+// A file in the temporary directory that is removed again at the end of the test.
+class ScriptFile {
+    std::filesystem::path path_;
+
+public:
+    ScriptFile(const std::string& name, const std::string& source)
+        : path_(std::filesystem::temp_directory_path() / name) {
+        std::ofstream(path_) << source;
+    }
+    ~ScriptFile() {
+        std::filesystem::remove(path_);
+    }
+
+    std::string Path() const { return path_.string(); }
+};
+
+TEST_CASE("RunFile evaluates every form") {
+    ScriptFile script("scheme_run_file.scm", R"EOF(
+        (define (square x)
+          (* x x))
+
+        (define xs
+          '(1 2
+            3))
+        (square (car (cdr (cdr xs))))
+    )EOF");
+
+    Interpreter interpreter;
+    REQUIRE(interpreter.RunFile(script.Path()) == "9");
+    REQUIRE(interpreter.Run("(square 4)") == "16");
+}
+
+TEST_CASE("RunFile of an empty file") {
+    ScriptFile script("scheme_empty.scm", "");
+
+    Interpreter interpreter;
+    REQUIRE(interpreter.RunFile(script.Path()).empty());
+}
+
+TEST_CASE("RunFile reports errors") {
+    Interpreter interpreter;
+    REQUIRE_THROWS_AS(interpreter.RunFile("/nonexistent/script.scm"), RuntimeError);
+    REQUIRE_THROWS_AS(interpreter.RunFile(std::filesystem::temp_directory_path()), RuntimeError);
+
+    ScriptFile script("scheme_broken.scm", "(define x 1) (car x)");
+    REQUIRE_THROWS_AS(interpreter.RunFile(script.Path()), RuntimeError);
+    // The forms before the error are evaluated.
+    REQUIRE(interpreter.Run("x") == "1");
+
+    // Unless the file does not read, then none are.
+    ScriptFile unfinished("scheme_unfinished.scm", "(define y 1) (define (f) y");
+    REQUIRE_THROWS_AS(interpreter.RunFile(unfinished.Path()), SyntaxError);
+    REQUIRE_THROWS_AS(interpreter.Run("y"), NameError);
+}
+
+TEST_CASE("Load builtin") {
+    ScriptFile library("scheme_library.scm", R"EOF(
+        (define (range a b)
+          (if (< a b) (cons a (range (+ a 1) b)) '()))
+        (define loaded #t)
+    )EOF");
+    ScriptFile main("scheme_main.scm", "(load '|" + library.Path() + "|) (range 0 3)");
+
+    Interpreter interpreter;
+    REQUIRE(interpreter.Run("(load '|" + library.Path() + "|)") == "()");
+    REQUIRE(interpreter.Run("loaded") == "#t");
+    REQUIRE(interpreter.RunFile(main.Path()) == "(0 1 2)");
+
+    // Definitions go to the interpreter that loads them.
+    Interpreter other;
+    REQUIRE_THROWS_AS(other.Run("loaded"), NameError);
+
+    REQUIRE_THROWS_AS(interpreter.Run("(load '|no_such_file.scm|)"), RuntimeError);
+    REQUIRE_THROWS_AS(interpreter.Run("(load 1)"), RuntimeError);
+}
+
+TEST_CASE("Load keeps the profiler stack balanced") {
+    ScriptFile library("scheme_profiled.scm", R"EOF(
+        (define (count n) (if (= n 0) 0 (+ 1 (count (- n 1)))))
+        (count 10)
+    )EOF");
+
+    Interpreter interpreter;
+    interpreter.Run("(define (run) (load '|" + library.Path() + "|) (count 5))");
+    Profiler::Instance().Start();
+    REQUIRE(interpreter.Run("(run)") == "5");
+    REQUIRE(Profiler::Instance().GetDepth() == 0);
+    REQUIRE_THROWS_AS(interpreter.Run("(load '|no_such_file.scm|)"), RuntimeError);
+    REQUIRE(Profiler::Instance().GetDepth() == 0);
+    Profiler::Instance().Stop();
+
+    auto procedures = Profiler::Instance().GetProcedures();
+    auto calls = [&](const std::string& name) {
+        auto it = std::find_if(procedures.begin(), procedures.end(),
+                               [&](auto& procedure) { return procedure.name == name; });
+        return it == procedures.end() ? 0 : it->calls;
+    };
+    REQUIRE(calls("count") == 17);
+    REQUIRE(calls("load") == 2);
+    REQUIRE(calls("run") == 1);
+}
+
+TEST_CASE("Load collects garbage between forms") {
+    std::string source;
+    for (int i = 0; i < 200; ++i) {
+        source += "(define xs (range 0 100))\n";
+    }
+    ScriptFile script("scheme_garbage.scm", "(define (range a b)"
+                                            "  (if (< a b) (cons a (range (+ a 1) b)) '()))" +
+                                                source);
+
+    Interpreter interpreter;
+    REQUIRE(interpreter.Run("(define ys (list 1 2 3))") == "()");
+    REQUIRE(interpreter.Run("(begin (load '|" + script.Path() + "|) (list-ref ys 2))") == "3");
+    REQUIRE(interpreter.Run("(list-ref xs 99)") == "99");
+}
+
+TEST_CASE("Code arena shares equal constants") {
+    auto& arena = CodeArena::Instance();
+    auto read = [](const char* source) {
+        Reader reader{std::string_view(source)};
+        return *reader.Next();
+    };
+
+    auto list = arena.Intern(read("(1 (2 3) . 4611686018427387904)"));
+    REQUIRE(list.GetObject()->IsPermanent());
+    REQUIRE(ToString(list) == "(1 (2 3) . 4611686018427387904)");
+    REQUIRE(arena.Intern(read("(1 (2 3) . 4611686018427387904)")) == list);
+
+    auto size = arena.Size();
+    auto sublist = As<Cell>(As<Cell>(list)->GetSecond())->GetFirst();
+    REQUIRE(arena.Intern(read("(2 3)")) == sublist);
+    REQUIRE(arena.Intern(read("4611686018427387904")) == As<Cell>(As<Cell>(list)->GetSecond())->GetSecond());
+    REQUIRE(arena.Size() == size);
+
+    REQUIRE(arena.Intern(read("(2 3 4)")) != sublist);
+    REQUIRE(arena.Size() > size);
+}
+
+TEST_CASE("Loaded code lives in the code arena") {
+    ScriptFile library("scheme_arena.scm", R"EOF(
+        (define xs '(1 2 3))
+        (define (make-adder n) (lambda (x) (+ x n)))
+        (define add-two (make-adder 2))
+    )EOF");
+
+    auto& heap = Heap::Instance();
+    auto before = CodeArena::Instance().Size();
+    auto codes = [&] {
+        return heap.Stats().usage[static_cast<size_t>(ObjectType::CODE)].objects;
+    };
+    auto heap_codes = codes();
+
+    Interpreter interpreter;
+    interpreter.RunFile(library.Path());
+    REQUIRE(CodeArena::Instance().Size() > before);
+    REQUIRE(codes() == heap_codes);
+
+    // Their constants are shared, so they must not change.
+    REQUIRE_THROWS_AS(interpreter.Run("(set-car! xs 5)"), RuntimeError);
+    REQUIRE_THROWS_AS(interpreter.Run("(set-cdr! (cdr xs) 5)"), RuntimeError);
+    REQUIRE(interpreter.Run("(define ys (cons 0 xs)) (set-car! ys 5) ys") == "(5 1 2 3)");
+
+    HeapSettings settings;
+    settings.SetCompacting(true);
+    for (int i = 0; i < 3; ++i) {
+        interpreter.Run("(define zs (list (add-two 1) ((make-adder 3) 1)))");
+        heap.Compact();
+    }
+    REQUIRE(interpreter.Run("zs") == "(3 4)");
+    REQUIRE(interpreter.Run("xs") == "(1 2 3)");
+    REQUIRE(interpreter.Run("(load '|" + library.Path() + "|) (add-two 40)") == "42");
+}
+
+TEST_CASE("Loading a file again adds nothing to the code arena") {
+    ScriptFile library("scheme_reload.scm", R"EOF(
+        (define xs '(1 (2 3)))
+        (define (make-adder n) (lambda (x) (+ x n)))
+        (define (twice f) (lambda (x) (f (f x))))
+        (define add-four (twice (make-adder 2)))
+        (add-four 1)
+    )EOF");
+
+    Interpreter interpreter;
+    REQUIRE(interpreter.RunFile(library.Path()) == "5");
+    auto size = CodeArena::Instance().Size();
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(interpreter.RunFile(library.Path()) == "5");
+        REQUIRE(interpreter.Run("(load '|" + library.Path() + "|) (add-four 2)") == "6");
+    }
+    REQUIRE(CodeArena::Instance().Size() == size);
+}
+
+TEST_CASE("Heap image restores definitions") {
+    ScriptFile library("scheme_image_library.scm", R"EOF(
+        (define (even? n) (if (= n 0) #t (odd? (- n 1))))
+        (define (odd? n) (if (= n 0) #f (even? (- n 1))))
+        (define big '(4611686018427387904 (1 2)))
+    )EOF");
+    ScriptFile image("scheme_image.img", "");
+
+    {
+        Interpreter interpreter;
+        interpreter.RunFile(library.Path());
+        interpreter.Run("(define (make-counter) (define n 0) (lambda () (set! n (+ n 1)) n))");
+        interpreter.Run("(define counter (make-counter)) (counter)");
+        interpreter.Run("(define xs (list 1 2 3)) (define ys (cons 0 xs))");
+        interpreter.Run("(define quoted '((1) 2))");
+        interpreter.Run("(define first car) (define car cdr)");
+        interpreter.SaveImage(image.Path());
+    }
+    Heap::Instance().Collect();
+
+    Interpreter interpreter;
+    interpreter.LoadImage(image.Path());
+    REQUIRE(interpreter.Run("(even? 10)") == "#t");
+    REQUIRE(interpreter.Run("big") == "(4611686018427387904 (1 2))");
+    REQUIRE(interpreter.Run("(counter)") == "2");
+    REQUIRE(interpreter.Run("(counter)") == "3");
+    REQUIRE(interpreter.Run("(first xs)") == "1");
+    REQUIRE(interpreter.Run("(car xs)") == "(2 3)");
+
+    // Objects shared before saving stay shared, and constants stay constant.
+    REQUIRE(interpreter.Run("(set-car! xs 5) ys") == "(0 5 2 3)");
+    REQUIRE_THROWS_AS(interpreter.Run("(set-car! big 5)"), RuntimeError);
+    REQUIRE_THROWS_AS(interpreter.Run("(set-car! (first quoted) 5)"), RuntimeError);
+    REQUIRE(interpreter.Run("quoted") == "((1) 2)");
+
+    Heap::Instance().Compact();
+    REQUIRE(interpreter.Run("(list (odd? 7) (counter))") == "(#t 4)");
+}
+
+TEST_CASE("Heap image rejects corrupted data") {
+    ScriptFile image("scheme_image_valid.img", "");
+    {
+        Interpreter interpreter;
+        interpreter.Run("(define (make-counter) (define n 0) (lambda () (set! n (+ n 1)) n))");
+        interpreter.Run("(define counter (make-counter))");
+        interpreter.Run("(define (f xs) (if (null? xs) 0 (+ (car xs) (f (cdr xs)))))");
+        interpreter.Run("(define xs '(1 #t (a . b)))");
+        interpreter.SaveImage(image.Path());
+    }
+    std::string data;
+    {
+        std::ifstream in(image.Path(), std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(in), {});
+    }
+    REQUIRE(not data.empty());
+
+    // A flipped byte either still makes a valid image, e.g. in a number or a
+    // symbol name, or the image is rejected; it never loads broken objects.
+    size_t rejected = 0;
+    for (size_t i = 0; i < data.size(); ++i) {
+        auto corrupted = data;
+        corrupted[i] ^= 0xff;
+        std::ofstream(image.Path(), std::ios::binary | std::ios::trunc) << corrupted;
+        Interpreter interpreter;
+        try {
+            interpreter.LoadImage(image.Path());
+        } catch (const RuntimeError&) {
+            ++rejected;
+        }
+    }
+    REQUIRE(rejected > data.size() / 2);
+
+    std::ofstream(image.Path(), std::ios::binary | std::ios::trunc) << data.substr(0, data.size() - 1);
+    Interpreter interpreter;
+    REQUIRE_THROWS_AS(interpreter.LoadImage(image.Path()), RuntimeError);
+}
+
+TEST_CASE("Heap image rejects bytecode that leaves its frames and stack") {
+    ScriptFile image("scheme_image_bytecode.img", "");
+    {
+        Interpreter interpreter;
+        interpreter.Run("(define (identity x) x)");
+        interpreter.Run("(define (call f) (f))");
+        interpreter.SaveImage(image.Path());
+    }
+    std::string data;
+    {
+        std::ifstream in(image.Path(), std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(in), {});
+    }
+    // An instruction as the image stores it.
+    auto instruction = [](OpCode op, uint16_t depth, uint32_t arg) {
+        std::string bytes(1 + sizeof(depth) + sizeof(arg), '\0');
+        bytes[0] = static_cast<char>(op);
+        std::memcpy(&bytes[1], &depth, sizeof(depth));
+        std::memcpy(&bytes[1 + sizeof(depth)], &arg, sizeof(arg));
+        return bytes;
+    };
+    auto load = [&](const std::string& from, const std::string& to) {
+        auto corrupted = data;
+        auto pos = corrupted.find(from);
+        REQUIRE(pos != std::string::npos);
+        corrupted.replace(pos, from.size(), to);
+        std::ofstream(image.Path(), std::ios::binary | std::ios::trunc) << corrupted;
+        Interpreter interpreter;
+        interpreter.LoadImage(image.Path());
+        return interpreter.Run("(call (lambda () (identity 1)))");
+    };
+
+    auto identity = instruction(OpCode::LOAD_LOCAL, 0, 0) + instruction(OpCode::RETURN, 0, 0);
+    auto call = instruction(OpCode::LOAD_LOCAL, 0, 0) + instruction(OpCode::TAIL_CALL, 0, 0);
+    REQUIRE(load(identity, identity) == "1");
+    REQUIRE_THROWS_AS(load(identity, instruction(OpCode::LOAD_LOCAL, 0, 1) +
+                                         instruction(OpCode::RETURN, 0, 0)),
+                      RuntimeError);
+    REQUIRE_THROWS_AS(load(identity, instruction(OpCode::SET_LOCAL, 1, 0) +
+                                         instruction(OpCode::RETURN, 0, 0)),
+                      RuntimeError);
+    REQUIRE_THROWS_AS(
+        load(identity, instruction(OpCode::POP, 0, 0) + instruction(OpCode::RETURN, 0, 0)),
+        RuntimeError);
+    REQUIRE_THROWS_AS(load(call, instruction(OpCode::LOAD_LOCAL, 0, 0) +
+                                     instruction(OpCode::TAIL_CALL, 0, 1)),
+                      RuntimeError);
+}
+
+TEST_CASE("Heap image reports errors") {
+    ScriptFile broken("scheme_broken.img", "SCMIMG");
+
+    Interpreter interpreter;
+    REQUIRE_THROWS_AS(interpreter.LoadImage("/nonexistent/image.img"), RuntimeError);
+    REQUIRE_THROWS_AS(interpreter.LoadImage(broken.Path()), RuntimeError);
+    REQUIRE_THROWS_AS(interpreter.SaveImage("/nonexistent/image.img"), RuntimeError);
+}
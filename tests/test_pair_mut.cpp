@@ -1,7 +1,7 @@
 #include "scheme_test.h"
 
 TEST_CASE_METHOD(SchemeTest, "PairMutations") {
-    ExpectNoError("(define x '(1 . 2))");
+    ExpectNoError("(define x (cons 1 2))");
 
     ExpectNoError("(set-car! x 5)");
     ExpectEq("(car x)", "5");
@@ -19,7 +19,7 @@ TEST_CASE_METHOD(SchemeTest, "PairMutations") {
 }
 
 TEST_CASE_METHOD(SchemeTest, "SelfReferenceCar") {
-    ExpectNoError("(define x '(1 . 2))");
+    ExpectNoError("(define x (cons 1 2))");
     ExpectNoError("(set-car! x x)");
     ExpectEq("(cdr (car (car (car x))))", "2");
 
@@ -34,7 +34,7 @@ TEST_CASE_METHOD(SchemeTest, "SelfReferenceCar") {
 }
 
 TEST_CASE_METHOD(SchemeTest, "SelfReferenceCdr") {
-    ExpectNoError("(define y '(1 . 2))");
+    ExpectNoError("(define y (cons 1 2))");
     ExpectNoError("(set-cdr! y y)");
     ExpectEq("(car (cdr (cdr (cdr y))))", "1");
 
@@ -47,3 +47,16 @@ TEST_CASE_METHOD(SchemeTest, "SelfReferenceCdr") {
     ExpectNoError("(set-cdr! (cdr (cdr y)) 3)");
     ExpectEq("(cdr y)", "3");
 }
+
+TEST_CASE_METHOD(SchemeTest, "QuotedDataAreConstant") {
+    ExpectNoError("(define x '(1 (2 3) . 4))");
+    ExpectRuntimeError("(set-car! x 5)");
+    ExpectRuntimeError("(set-cdr! (car (cdr x)) 5)");
+    ExpectNoError("(define (f) '(1 2))");
+    ExpectRuntimeError("(set-cdr! (f) 5)");
+    ExpectEq("x", "(1 (2 3) . 4)");
+
+    ExpectNoError("(define y (cons 0 x))");
+    ExpectNoError("(set-car! y 5)");
+    ExpectEq("y", "(5 1 (2 3) . 4)");
+}
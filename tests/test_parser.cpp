@@ -1,6 +1,8 @@
 #include <catch2/catch_all.hpp>
 
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include <scheme/error.h>
 #include <scheme/parser.h>
@@ -17,11 +19,11 @@ auto ReadFull(const std::string& str) {
 TEST_CASE("Read number") {
     auto node = ReadFull("5");
     REQUIRE(Is<Number>(node));
-    REQUIRE(As<Number>(node)->GetValue() == 5);
+    REQUIRE(AsInteger(node) == 5);
 
     node = ReadFull("-5");
     REQUIRE(Is<Number>(node));
-    REQUIRE(As<Number>(node)->GetValue() == -5);
+    REQUIRE(AsInteger(node) == -5);
 }
 
 std::string RandomSymbol(std::default_random_engine* rng) {
@@ -51,6 +53,27 @@ TEST_CASE("Read symbol") {
     }
 }
 
+TEST_CASE("Read symbol between bars") {
+    auto node = ReadFull("|lib/list_utils.scm|");
+    REQUIRE(Is<Symbol>(node));
+    REQUIRE(As<Symbol>(node)->GetName() == "lib/list_utils.scm");
+
+    REQUIRE(ReadFull("|#t|") == Symbol::Intern("#t"));
+    REQUIRE(ReadFull("|(a b)|") == Symbol::Intern("(a b)"));
+    REQUIRE(ReadFull("||") == Symbol::Intern(""));
+    // Without bars, the dot still separates the two parts of a pair.
+    REQUIRE(ToString(ReadFull("(a.b)")) == "(a . b)");
+}
+
+TEST_CASE("Symbols are interned") {
+    auto list = ReadFull("(foo bar foo)");
+    auto first = As<Cell>(list)->GetFirst();
+    auto third = As<Cell>(As<Cell>(As<Cell>(list)->GetSecond())->GetSecond())->GetFirst();
+    REQUIRE(first == third);
+    REQUIRE(ReadFull("bar") == As<Cell>(As<Cell>(list)->GetSecond())->GetFirst());
+    REQUIRE(ReadFull("foo") == Symbol::Intern("foo"));
+}
+
 TEST_CASE("Lists") {
     SECTION("Empty list") {
         auto null = ReadFull("()");
@@ -63,11 +86,11 @@ TEST_CASE("Lists") {
 
         auto first = As<Cell>(pair)->GetFirst();
         REQUIRE(Is<Number>(first));
-        REQUIRE(As<Number>(first)->GetValue() == 1);
+        REQUIRE(AsInteger(first) == 1);
 
         auto second = As<Cell>(pair)->GetSecond();
         REQUIRE(Is<Number>(second));
-        REQUIRE(As<Number>(second)->GetValue() == 2);
+        REQUIRE(AsInteger(second) == 2);
     }
 
     SECTION("Simple list") {
@@ -76,12 +99,12 @@ TEST_CASE("Lists") {
 
         auto first = As<Cell>(list)->GetFirst();
         REQUIRE(Is<Number>(first));
-        REQUIRE(As<Number>(first)->GetValue() == 1);
+        REQUIRE(AsInteger(first) == 1);
 
         list = As<Cell>(list)->GetSecond();
         auto second = As<Cell>(list)->GetFirst();
         REQUIRE(Is<Number>(second));
-        REQUIRE(As<Number>(second)->GetValue() == 2);
+        REQUIRE(AsInteger(second) == 2);
 
         REQUIRE(!As<Cell>(list)->GetSecond());
     }
@@ -97,12 +120,12 @@ TEST_CASE("Lists") {
         list = As<Cell>(list)->GetSecond();
         auto second = As<Cell>(list)->GetFirst();
         REQUIRE(Is<Number>(second));
-        REQUIRE(As<Number>(second)->GetValue() == 1);
+        REQUIRE(AsInteger(second) == 1);
 
         list = As<Cell>(list)->GetSecond();
         second = As<Cell>(list)->GetFirst();
         REQUIRE(Is<Number>(second));
-        REQUIRE(As<Number>(second)->GetValue() == 2);
+        REQUIRE(AsInteger(second) == 2);
 
         REQUIRE(!As<Cell>(list)->GetSecond());
     }
@@ -114,16 +137,16 @@ TEST_CASE("Lists") {
 
         auto first = As<Cell>(list)->GetFirst();
         REQUIRE(Is<Number>(first));
-        REQUIRE(As<Number>(first)->GetValue() == 1);
+        REQUIRE(AsInteger(first) == 1);
 
         list = As<Cell>(list)->GetSecond();
         auto second = As<Cell>(list)->GetFirst();
         REQUIRE(Is<Number>(second));
-        REQUIRE(As<Number>(second)->GetValue() == 2);
+        REQUIRE(AsInteger(second) == 2);
 
         auto last = As<Cell>(list)->GetSecond();
         REQUIRE(Is<Number>(last));
-        REQUIRE(As<Number>(last)->GetValue() == 3);
+        REQUIRE(AsInteger(last) == 3);
     }
 
     SECTION("Complex lists") {
@@ -154,3 +177,121 @@ TEST_CASE("Invalid") {
     REQUIRE_THROWS_AS(ReadFull("(1 . )"), SyntaxError);
     REQUIRE_THROWS_AS(ReadFull("(1 . 2 3)"), SyntaxError);
 }
+
+// Feeds the chunks one by one and prints every datum as soon as it is read.
+static std::vector<std::string> ReadChunks(const std::vector<std::string>& chunks) {
+    Reader reader;
+    std::vector<std::string> datums;
+    for (auto& chunk : chunks) {
+        reader.Feed(chunk);
+        while (auto datum = reader.Next()) {
+            datums.push_back(ToString(*datum));
+        }
+        datums.push_back("|");
+    }
+    reader.Finish();
+    while (auto datum = reader.Next()) {
+        datums.push_back(ToString(*datum));
+    }
+    return datums;
+}
+
+TEST_CASE("Reader splits chunks into datums") {
+    using Datums = std::vector<std::string>;
+
+    SECTION("Several datums in a chunk") {
+        REQUIRE(ReadChunks({"(1 2) x '(3) 4 "}) == Datums{"(1 2)", "x", "(quote (3))", "4", "|"});
+    }
+
+    SECTION("Datums split across chunks") {
+        REQUIRE(ReadChunks({"(define (f x", ")\n (+ x 1", "))(f", " 1) "}) ==
+                Datums{"|", "|", "(define (f x) (+ x 1))", "|", "(f 1)", "|"});
+    }
+
+    SECTION("An atom at the end of a chunk may continue") {
+        REQUIRE(ReadChunks({"12", "34 ab", "c"}) == Datums{"|", "1234", "|", "|", "abc"});
+        REQUIRE(ReadChunks({"'", "x", " "}) == Datums{"|", "|", "(quote x)", "|"});
+    }
+
+    SECTION("Blanks and brackets between bars do not end an atom") {
+        REQUIRE(ReadChunks({"(load '|a (b", "|) c"}) == Datums{"|", "(load (quote a (b))", "|", "c"});
+    }
+
+    SECTION("Atoms end at brackets and quotes") {
+        REQUIRE(ReadChunks({"a(b)c'd"}) == Datums{"a", "(b)", "c", "|", "(quote d)"});
+    }
+}
+
+TEST_CASE("Reader reports malformed datums") {
+    SECTION("The rest is still read") {
+        Reader reader{std::string_view(") (1 . 2 3) 1.5 12ab $ (x)")};
+        for (int i = 0; i < 5; ++i) {
+            REQUIRE_THROWS_AS(reader.Next(), SyntaxError);
+        }
+        REQUIRE(ToString(*reader.Next()) == "(x)");
+        REQUIRE(!reader.Next());
+    }
+
+    SECTION("Unfinished input") {
+        Reader reader;
+        reader.Feed("(1 (2)  ");
+        REQUIRE(!reader.Next());
+        REQUIRE(reader.HasPartial());
+        reader.Finish();
+        REQUIRE_THROWS_AS(reader.Next(), SyntaxError);
+        REQUIRE(!reader.HasPartial());
+    }
+
+    SECTION("Blanks are not a datum") {
+        Reader reader;
+        reader.Feed(" \n\t ");
+        REQUIRE(!reader.HasPartial());
+        reader.Finish();
+        REQUIRE(!reader.Next());
+    }
+}
+
+TEST_CASE("Long lists") {
+    constexpr int kLength = 300000;
+    std::string source = "(";
+    for (int i = 0; i < kLength; ++i) {
+        source += std::to_string(i) + " ";
+    }
+    source += ". end)";
+
+    Tokenizer tokenizer{std::string_view(source)};
+    auto list = Read(&tokenizer);
+    REQUIRE(tokenizer.IsEnd());
+    for (int i = 0; i < kLength; ++i) {
+        REQUIRE(AsInteger(As<Cell>(list)->GetFirst()) == i);
+        list = As<Cell>(list)->GetSecond();
+    }
+    REQUIRE(As<Symbol>(list)->GetName() == "end");
+}
+
+TEST_CASE("Deeply nested lists") {
+    auto nested = [](size_t depth) {
+        return std::string(depth, '(') + "x" + std::string(depth, ')');
+    };
+
+    SECTION("Up to the maximum depth") {
+        auto datum = ReadFull(nested(kDefaultMaxDepth));
+        for (size_t i = 0; i < kDefaultMaxDepth; ++i) {
+            REQUIRE(!As<Cell>(datum)->GetSecond());
+            datum = As<Cell>(datum)->GetFirst();
+        }
+        REQUIRE(As<Symbol>(datum)->GetName() == "x");
+    }
+
+    SECTION("Beyond it") {
+        REQUIRE_THROWS_AS(ReadFull(nested(kDefaultMaxDepth + 1)), SyntaxError);
+        REQUIRE_THROWS_AS(ReadFull(std::string(kDefaultMaxDepth + 1, '\'') + "x"), SyntaxError);
+    }
+
+    SECTION("Configured") {
+        Reader reader{std::string_view("(((x))) ((x))")};
+        reader.SetMaxDepth(2);
+        REQUIRE_THROWS_AS(reader.Next(), SyntaxError);
+        REQUIRE(ToString(*reader.Next()) == "((x))");
+    }
+}
@@ -0,0 +1,105 @@
+#include "scheme_test.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include <time.h>
+
+#include <scheme/profiler.h>
+
+namespace {
+
+Profiler::Procedure FindProcedure(const std::string& name) {
+    auto procedures = Profiler::Instance().GetProcedures();
+    auto it = std::find_if(procedures.begin(), procedures.end(),
+                           [&](auto& procedure) { return procedure.name == name; });
+    REQUIRE(it != procedures.end());
+    return *it;
+}
+
+std::chrono::nanoseconds CpuTime() {
+    timespec now{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return std::chrono::seconds{now.tv_sec} + std::chrono::nanoseconds{now.tv_nsec};
+}
+
+}  // namespace
+
+TEST_CASE_METHOD(SchemeTest, "ProfilerCountsCalls") {
+    ExpectNoError("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+    ExpectNoError("(define (loop n) (if (> n 0) (loop (- n 1)) n))");
+    ExpectNoError("(define twice (lambda (x) (* 2 x)))");
+    Profiler::Instance().Start();
+    ExpectEq("(fib 10)", "55");
+    ExpectEq("(loop 100)", "0");
+    ExpectEq("(twice ((lambda (x) x) 4))", "8");
+    Profiler::Instance().Stop();
+
+    REQUIRE(FindProcedure("fib").calls == 177);
+    REQUIRE(FindProcedure("+").calls == 88);
+    REQUIRE(FindProcedure("loop").calls == 101);
+    REQUIRE(FindProcedure("twice").calls == 1);
+    REQUIRE(FindProcedure("lambda").calls == 1);
+    REQUIRE(Profiler::Instance().GetDepth() == 0);
+}
+
+TEST_CASE_METHOD(SchemeTest, "ProfilerSamplesCallStacks") {
+    ExpectNoError("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+    // Not a tail call, which would replace run on the stack.
+    ExpectNoError("(define (run) (+ (fib 22) 0))");
+    Profiler::Instance().Start(std::chrono::microseconds{100});
+    for (int i = 0; i < 100 && Profiler::Instance().GetSampleCount() < 20; ++i) {
+        ExpectEq("(run)", "17711");
+    }
+    Profiler::Instance().Stop();
+    REQUIRE(Profiler::Instance().GetSampleCount() >= 20);
+
+    std::stringstream folded;
+    Profiler::Instance().WriteFolded(folded);
+    std::string line;
+    size_t samples = 0;
+    bool recursion = false;
+    while (std::getline(folded, line)) {
+        // Samples taken between calls, e.g. while collecting, have an empty stack.
+        REQUIRE((line.starts_with("run") || line.starts_with("toplevel ")));
+        recursion |= line.starts_with("run;fib;fib;");
+        samples += std::stoul(line.substr(line.rfind(' ') + 1));
+    }
+    REQUIRE(recursion);
+    REQUIRE(samples == Profiler::Instance().GetSampleCount());
+
+    auto run = FindProcedure("run");
+    auto fib = FindProcedure("fib");
+    REQUIRE(run.inclusive >= fib.inclusive);
+    REQUIRE(fib.inclusive > fib.exclusive);
+    REQUIRE(fib.inclusive.count() > 0);
+}
+
+TEST_CASE_METHOD(SchemeTest, "ProfilerReportsCpuTime") {
+    ExpectNoError("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+    ExpectNoError("(define (run) (+ (fib 20) 0))");
+    auto start = CpuTime();
+    Profiler::Instance().Start();
+    while (CpuTime() - start < std::chrono::milliseconds{300}) {
+        ExpectEq("(run)", "6765");
+    }
+    Profiler::Instance().Stop();
+    auto measured = CpuTime() - start;
+
+    // Almost all of the time is spent in run, the rest in reading and
+    // compiling the expressions.
+    auto run = FindProcedure("run").inclusive;
+    REQUIRE(run <= measured);
+    REQUIRE(run >= measured * 3 / 4);
+}
+
+TEST_CASE_METHOD(SchemeTest, "ProfilerStackUnwindsOnErrors") {
+    ExpectNoError("(define (f x) (car x))");
+    Profiler::Instance().Start();
+    ExpectRuntimeError("(f 1)");
+    REQUIRE(Profiler::Instance().GetDepth() == 0);
+    ExpectEq("(f '(1))", "1");
+    Profiler::Instance().Stop();
+    REQUIRE(FindProcedure("f").calls == 2);
+    REQUIRE(FindProcedure("car").calls == 2);
+}
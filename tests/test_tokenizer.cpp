@@ -4,6 +4,7 @@
 #include <scheme/tokenizer.h>
 
 #include <sstream>
+#include <vector>
 
 TEST_CASE("Tokenizer works on simple case") {
     std::stringstream ss{"4+)'."};
@@ -70,6 +71,36 @@ TEST_CASE("Symbol names") {
     REQUIRE(tokenizer.GetToken() == Token{SymbolToken{"Am1good?"}});
 }
 
+TEST_CASE("Dots are not part of symbol names") {
+    std::vector<Token> expected = {BracketToken::OPEN, SymbolToken{"a"}, DotToken{},
+                                   SymbolToken{"b"}, BracketToken::CLOSE};
+    for (auto source : {"(a.b)", "(a . b)"}) {
+        Tokenizer tokenizer{std::string_view(source)};
+        std::vector<Token> tokens;
+        for (; !tokenizer.IsEnd(); tokenizer.Next()) {
+            tokens.push_back(tokenizer.GetToken());
+        }
+        REQUIRE(tokens == expected);
+    }
+}
+
+TEST_CASE("Symbol names between bars") {
+    Tokenizer tokenizer{std::string_view("|lib/a.b_c.scm| |#t|(|x y|)")};
+    REQUIRE(tokenizer.GetToken() == Token{SymbolToken{"|lib/a.b_c.scm|"}});
+    tokenizer.Next();
+    REQUIRE(tokenizer.GetToken() == Token{SymbolToken{"|#t|"}});
+    tokenizer.Next();
+    REQUIRE(tokenizer.GetToken() == Token{BracketToken::OPEN});
+    tokenizer.Next();
+    REQUIRE(tokenizer.GetToken() == Token{SymbolToken{"|x y|"}});
+    tokenizer.Next();
+    REQUIRE(tokenizer.GetToken() == Token{BracketToken::CLOSE});
+    tokenizer.Next();
+    REQUIRE(tokenizer.IsEnd());
+
+    REQUIRE_THROWS_AS(Tokenizer{std::string_view("|a.b")}, SyntaxError);
+}
+
 TEST_CASE("GetToken is not moving") {
     std::stringstream ss{"1234+4"};
     Tokenizer tokenizer{&ss};
@@ -153,3 +184,54 @@ TEST_CASE("Empty string handled correctly") {
 
     REQUIRE(tokenizer.IsEnd());
 }
+
+TEST_CASE("Tokenizer scans a string in place") {
+    std::string source = "(define (f x) '(x . 12))";
+    Tokenizer tokenizer{std::string_view(source)};
+
+    std::vector<Token> tokens;
+    for (; !tokenizer.IsEnd(); tokenizer.Next()) {
+        auto token = tokenizer.GetToken();
+        if (auto* symbol = std::get_if<SymbolToken>(&token)) {
+            // Symbol names are not copied out of the source.
+            REQUIRE(symbol->name.data() >= source.data());
+            REQUIRE(symbol->name.data() + symbol->name.size() <= source.data() + source.size());
+        }
+        tokens.push_back(token);
+    }
+
+    std::vector<Token> expected = {
+        BracketToken::OPEN, SymbolToken{"define"}, BracketToken::OPEN, SymbolToken{"f"},
+        SymbolToken{"x"},   BracketToken::CLOSE,   QuoteToken{},       BracketToken::OPEN,
+        SymbolToken{"x"},   DotToken{},            ConstantToken{12},  BracketToken::CLOSE,
+        BracketToken::CLOSE};
+    REQUIRE(tokens == expected);
+}
+
+TEST_CASE("Integer literals") {
+    SECTION("Signs") {
+        Tokenizer tokenizer{std::string_view("+7 -7 + -")};
+        REQUIRE(tokenizer.GetToken() == Token{ConstantToken{7}});
+        tokenizer.Next();
+        REQUIRE(tokenizer.GetToken() == Token{ConstantToken{-7}});
+        tokenizer.Next();
+        REQUIRE(tokenizer.GetToken() == Token{SymbolToken{"+"}});
+        tokenizer.Next();
+        REQUIRE(tokenizer.GetToken() == Token{SymbolToken{"-"}});
+        tokenizer.Next();
+        REQUIRE(tokenizer.IsEnd());
+    }
+
+    SECTION("Full 64-bit range") {
+        std::stringstream ss{"9223372036854775807 -9223372036854775808"};
+        Tokenizer tokenizer{&ss};
+        REQUIRE(tokenizer.GetToken() == Token{ConstantToken{INT64_MAX}});
+        tokenizer.Next();
+        REQUIRE(tokenizer.GetToken() == Token{ConstantToken{INT64_MIN}});
+    }
+
+    SECTION("Out of range") {
+        REQUIRE_THROWS_AS(Tokenizer{std::string_view("9223372036854775808")}, SyntaxError);
+        REQUIRE_THROWS_AS(Tokenizer{std::string_view("-99999999999999999999")}, SyntaxError);
+    }
+}